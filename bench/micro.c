@@ -0,0 +1,172 @@
+/* bench/micro.c
+ * Per-call microbenchmarks of the shell core (`make bench-micro`).
+ *
+ * Links libmyshell.a and calls tokenize, expand_tokens, the variable
+ * store and the job table directly, with no process creation. Each case
+ * runs a fixed number of batches of the same operation and reports the
+ * fastest and the median batch as nanoseconds per call; the minimum is
+ * the stable number to compare across changes, the median shows noise.
+ *
+ * usage: bench_micro [scale]
+ */
+
+#include "shell.h"
+
+#define BATCH 1000
+
+static double scale = 1.0;
+static volatile size_t sink;    /* keeps results observable */
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+typedef void (*op_fn)(void *ctx, int i);
+
+/* Time `batches` runs of BATCH calls of op and print ns per call */
+static void measure(const char *label, op_fn op, void *ctx) {
+    int batches = (int)(200 * scale);
+    if (batches < 3) batches = 3;
+    double *t = malloc(sizeof(double) * (size_t)batches);
+    if (t == NULL) return;
+
+    for (int i = 0; i < BATCH; ++i) op(ctx, i);   /* warm caches and tables */
+    for (int b = 0; b < batches; ++b) {
+        double t0 = now_ns();
+        for (int i = 0; i < BATCH; ++i) op(ctx, i);
+        t[b] = (now_ns() - t0) / BATCH;
+    }
+    qsort(t, (size_t)batches, sizeof(double), cmp_double);
+    printf("%-40s min %9.1f ns  median %9.1f ns\n", label, t[0], t[batches / 2]);
+    fflush(stdout);
+    free(t);
+}
+
+/* ---------- tokenizer ---------- */
+
+static void op_tokenize(void *ctx, int i) {
+    (void)i;
+    tokens_t *t = tokenize(ctx);
+    sink += (size_t)t->argc;
+    free_tokens(t);
+}
+
+/* ---------- expansion ---------- */
+
+static void op_expand(void *ctx, int i) {
+    (void)i;
+    tokens_t *t = tokens_share(ctx);
+    expand_tokens(t);
+    sink += (size_t)t->argc;
+    free_tokens(t);
+}
+
+/* ---------- variable store ---------- */
+
+typedef struct {
+    char (*names)[16];
+    int n;
+} names_t;
+
+static void op_get_hit(void *ctx, int i) {
+    names_t *nm = ctx;
+    sink += (size_t)get_var(nm->names[(i * 7919) % nm->n]);
+}
+
+static void op_get_miss(void *ctx, int i) {
+    (void)ctx;
+    static const char *const misses[] = { "nope", "missing_var", "x1y2z3", "UNSET_NAME" };
+    sink += (size_t)get_var(misses[i & 3]);
+}
+
+static void op_set_existing(void *ctx, int i) {
+    names_t *nm = ctx;
+    sink += (size_t)set_var(nm->names[(i * 7919) % nm->n], (i & 1) ? "odd" : "even");
+}
+
+/* ---------- job table ---------- */
+
+/* Pids far above pid_max, so no real child is ever confused with them */
+#define FAKE_PID_BASE 0x30000000
+
+static void op_job_cycle(void *ctx, int i) {
+    (void)ctx;
+    pid_t pids[3] = { FAKE_PID_BASE + 3 * i, FAKE_PID_BASE + 3 * i + 1, FAKE_PID_BASE + 3 * i + 2 };
+    int id = add_job(pids, 3, "a | b | c");
+    job_t done;
+    for (int k = 0; k < 3; ++k) {
+        if (job_note_exit(pids[k], 0, NULL, &done) > 0) free(done.cmd);
+    }
+    sink += (size_t)id;
+}
+
+static void op_job_lookup(void *ctx, int i) {
+    (void)ctx;
+    /* an untracked pid still costs one index probe */
+    job_t done;
+    sink += (size_t)job_note_exit(FAKE_PID_BASE - 1 - (i & 1023), 0, NULL, &done);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) scale = atof(argv[1]);
+    if (scale <= 0) scale = 1.0;
+    printf("bench_micro: %d calls per batch, scale %.2f\n", BATCH, scale);
+
+    char short_line[] = "ls -la /tmp";
+    char quoted_line[] = "grep -v \"some pattern\" 'file name.txt' | sort -u > out.txt";
+    char long_line[1024];
+    size_t len = 0;
+    for (int w = 0; w < 64; ++w)
+        len += (size_t)snprintf(long_line + len, sizeof(long_line) - len, "word%d ", w);
+    measure("tokenize: 3 words", op_tokenize, short_line);
+    measure("tokenize: quotes + pipe + redirect", op_tokenize, quoted_line);
+    measure("tokenize: 64 words", op_tokenize, long_line);
+
+    set_var("HOME", "/home/bench");
+    set_var("USER", "bench");
+    char plain[] = "ls -la src include";
+    char vars[] = "echo $HOME ${USER}x \"$HOME/$USER\"";
+    tokens_t *plain_t = tokenize(plain);
+    tokens_t *vars_t = tokenize(vars);
+    measure("expand: no expansion needed", op_expand, plain_t);
+    measure("expand: 4 variable references", op_expand, vars_t);
+    free_tokens(plain_t);
+    free_tokens(vars_t);
+
+    int sizes[] = { 10, 1000, 100000 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        names_t nm = { malloc(16 * (size_t)sizes[s]), sizes[s] };
+        if (nm.names == NULL) return 1;
+        for (int i = 0; i < nm.n; ++i) {
+            snprintf(nm.names[i], 16, "var%d", i);
+            set_var(nm.names[i], "value");
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "get_var hit, %d vars", nm.n);
+        measure(label, op_get_hit, &nm);
+        snprintf(label, sizeof(label), "get_var miss, %d vars", nm.n);
+        measure(label, op_get_miss, &nm);
+        snprintf(label, sizeof(label), "set_var existing, %d vars", nm.n);
+        measure(label, op_set_existing, &nm);
+        free(nm.names);
+        free_all_variables();
+    }
+
+    measure("job table: add + 3 exits (3-stage job)", op_job_cycle, NULL);
+    pid_t live[100];
+    for (int i = 0; i < 100; ++i) {
+        live[i] = FAKE_PID_BASE + 0x1000000 + i;
+        add_job(&live[i], 1, "sleep");
+    }
+    measure("job table: add + 3 exits, 100 live", op_job_cycle, NULL);
+    measure("job table: untracked pid, 100 live", op_job_lookup, NULL);
+    for (int i = 0; i < 100; ++i) remove_job(live[i]);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* bench/startup.c
+ * Startup-to-first-exec benchmark.
+ *
+ * Spawns `myshell -c true` repeatedly and reports wall-time percentiles,
+ * next to spawning `true` directly; the difference is the shell's own
+ * startup cost up to its first exec.
+ *
+ * usage: bench_startup [shell] [scale]
+ *   scale  multiplies the 500 iterations; 0.1 for a quick smoke run
+ */
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *label, char *const argv[], int iters) {
+    double *t = malloc(sizeof(double) * (size_t)iters);
+    if (t == NULL) return;
+    double total = 0;
+    for (int i = 0; i < iters; ++i) {
+        pid_t pid;
+        double t0 = now_us();
+        if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0) {
+            perror(argv[0]);
+            free(t);
+            return;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        t[i] = now_us() - t0;
+        total += t[i];
+    }
+    qsort(t, (size_t)iters, sizeof(double), cmp_double);
+    printf("%-28s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  %8.0f runs/s\n",
+           label, t[iters / 2], t[iters * 90 / 100], t[iters * 99 / 100],
+           iters / (total / 1e6));
+    free(t);
+}
+
+int main(int argc, char *argv[]) {
+    char *shell = argc > 1 ? argv[1] : "bin/myshell";
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    if (scale <= 0) scale = 1.0;
+    int iters = (int)(500 * scale);
+    if (iters < 1) iters = 1;
+
+    char *direct[] = { "true", NULL };
+    char *cmode[] = { shell, "-c", "true", NULL };
+
+    printf("startup: %d iterations, scale %.2f\n", iters, scale);
+    run("true (direct spawn)", direct, iters);
+    run("myshell -c true", cmode, iters);
+    return 0;
+}
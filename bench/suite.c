@@ -0,0 +1,334 @@
+/* bench/suite.c
+ * Throughput benchmarks for the shell's hot paths (`make bench`).
+ *
+ * Linked against the shell's own objects, so commands go through the
+ * real execute_single / tokenize / expand_tokens / variable store. Inputs
+ * are generated from fixed seeds and sizes, so two runs on one machine
+ * measure the same work. Every line reports p50/p90/p99 of one sample
+ * (a call, a batch or a pass, as labelled) plus the overall rate.
+ *
+ * usage: bench_suite [shell] [scale]
+ *   shell  binary used for the end-to-end script runs (bin/myshell)
+ *   scale  multiplies iteration counts; 0.1 for a quick smoke run
+ */
+
+#include "shell.h"
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+
+static double scale = 1.0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int iters(int n) {
+    int k = (int)(n * scale);
+    return k < 1 ? 1 : k;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Print percentiles of n samples (microseconds each) and the rate of
+   `per_sample` units per sample over the total time */
+static void report(const char *label, double *t, int n, double per_sample, const char *unit) {
+    double total = 0;
+    for (int i = 0; i < n; ++i) total += t[i];
+    qsort(t, (size_t)n, sizeof(double), cmp_double);
+    printf("%-42s p50 %9.2f us  p90 %9.2f us  p99 %9.2f us  %12.0f %s\n",
+           label, t[n / 2], t[n * 90 / 100], t[n * 99 / 100],
+           per_sample * n / (total / 1e6), unit);
+    fflush(stdout);
+}
+
+/* Deterministic PRNG so corpora and lookups are the same every run */
+static unsigned long rng = 88172645463325252ul;
+
+static unsigned long next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* ---------- commands/sec through execute_single ---------- */
+
+static void bench_commands(void) {
+    struct {
+        const char *label;
+        char *argv[6];
+        int n;
+    } cases[] = {
+        { "execute_single: true (builtin)", { "true", NULL }, 200000 },
+        { "execute_single: /bin/true", { "/bin/true", NULL }, 2000 },
+        { "execute_single: /bin/true | /bin/true", { "/bin/true", "|", "/bin/true", NULL }, 1000 },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        int n = iters(cases[c].n);
+        double *t = malloc(sizeof(double) * (size_t)n);
+        if (t == NULL) return;
+        for (int i = 0; i < n; ++i) {
+            double t0 = now_us();
+            execute_single(cases[c].argv);
+            t[i] = now_us() - t0;
+        }
+        report(cases[c].label, t, n, 1, "cmds/s");
+        free(t);
+    }
+}
+
+/* ---------- pipe throughput ---------- */
+
+/* Run argv 5 times and report MB/s for mb megabytes per run */
+static void time_pipe(const char *label, char **argv, int mb) {
+    int n = 5;
+    double t[5];
+    for (int i = 0; i < n; ++i) {
+        double t0 = now_us();
+        execute_single(argv);
+        t[i] = now_us() - t0;
+    }
+    report(label, t, n, mb, "MB/s");
+}
+
+/* Write mb MiB of a repeating pattern to path (it stays in the page
+   cache, so the file runs measure the pipe, not the disk) */
+static int write_file(const char *path, int mb) {
+    char block[1 << 16];
+    for (size_t i = 0; i < sizeof(block); ++i) block[i] = (char)('a' + i % 26);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < mb * 16; ++i) fwrite(block, 1, sizeof(block), f);
+    return fclose(f);
+}
+
+/* A generated stream through one pipe at the default and the largest
+   pipe size, then a file fed by cat against a redirect-only stage
+   ("< file |", spliced into the pipe by the shell) */
+static void bench_pipe(void) {
+    int mb = iters(256);
+    char count[32], label[96];
+    snprintf(count, sizeof(count), "%dM", mb);
+    char *stream[] = { "head", "-c", count, "/dev/zero", "|", "cat", ">", "/dev/null", NULL };
+
+    set_pipe_size("default");
+    snprintf(label, sizeof(label), "pipe: head -c %s | cat", count);
+    time_pipe(label, stream, mb);
+    set_pipe_size("max");
+    snprintf(label, sizeof(label), "pipe: head -c %s | cat, %ldK pipe", count, get_pipe_size() / 1024);
+    time_pipe(label, stream, mb);
+
+    char path[] = "/tmp/myshell-bench-pipe-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        set_pipe_size("default");
+        return;
+    }
+    close(fd);
+    if (write_file(path, mb) == 0) {
+        char *cat_file[] = { "cat", path, "|", "cat", ">", "/dev/null", NULL };
+        char *splice_file[] = { "<", path, "|", "cat", ">", "/dev/null", NULL };
+        const char *sizes[] = { "default", "max" };
+        for (int k = 0; k < 2; ++k) {
+            set_pipe_size(sizes[k]);
+            snprintf(label, sizeof(label), "pipe: cat %dM file | cat, %s pipe", mb, sizes[k]);
+            time_pipe(label, cat_file, mb);
+            snprintf(label, sizeof(label), "pipe: < %dM file | cat, %s pipe", mb, sizes[k]);
+            time_pipe(label, splice_file, mb);
+        }
+    }
+    unlink(path);
+    set_pipe_size("default");
+}
+
+/* ---------- tokenizer ---------- */
+
+static const char *const corpus_words[] = {
+    "ls", "-la", "grep", "-v", "foo", "$HOME", "${PATH}", "\"quoted text here\"",
+    "'single $quoted'", "src/*.c", "|", ">", "out.txt", "<", "in.txt", "echo",
+    "$(date +%s)", "x=$y", "--long-option=value", "\"$a and $b\"", "&&", "wc",
+};
+
+static char** make_corpus(int nlines) {
+    char **lines = malloc(sizeof(char*) * (size_t)nlines);
+    if (lines == NULL) return NULL;
+    size_t nwords = sizeof(corpus_words) / sizeof(corpus_words[0]);
+    for (int i = 0; i < nlines; ++i) {
+        char buf[512];
+        size_t len = 0;
+        int words = 2 + (int)(next_rand() % 10);
+        for (int w = 0; w < words; ++w) {
+            const char *s = corpus_words[next_rand() % nwords];
+            len += (size_t)snprintf(buf + len, sizeof(buf) - len, "%s%s", w ? " " : "", s);
+        }
+        lines[i] = strdup(buf);
+    }
+    return lines;
+}
+
+static void bench_tokenizer(void) {
+    int nlines = 10000;
+    int passes = iters(100);
+    char **lines = make_corpus(nlines);
+    double *t = malloc(sizeof(double) * (size_t)passes);
+    if (lines == NULL || t == NULL) return;
+
+    for (int p = 0; p < passes; ++p) {
+        double t0 = now_us();
+        for (int i = 0; i < nlines; ++i) free_tokens(tokenize(lines[i]));
+        t[p] = now_us() - t0;
+    }
+    report("tokenize (pass = 10k lines)", t, passes, nlines, "lines/s");
+
+    for (int i = 0; i < nlines; ++i) free(lines[i]);
+    free(lines);
+    free(t);
+}
+
+/* ---------- variable lookup and expansion ---------- */
+
+static void bench_variables(int nvars) {
+    char name[32], value[32], label[64];
+    for (int i = 0; i < nvars; ++i) {
+        snprintf(name, sizeof(name), "v%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        set_var(name, value);
+    }
+
+    /* a sample is a batch of 1000 lookups of random existing names */
+    int batches = iters(1000);
+    double *t = malloc(sizeof(double) * (size_t)batches);
+    char (*names)[32] = malloc(32 * 1000);
+    if (t == NULL || names == NULL) return;
+    for (int b = 0; b < batches; ++b) {
+        for (int k = 0; k < 1000; ++k)
+            snprintf(names[k], 32, "v%lu", next_rand() % (unsigned long)nvars);
+        double t0 = now_us();
+        for (int k = 0; k < 1000; ++k)
+            if (get_var(names[k]) == NULL) abort();
+        t[b] = now_us() - t0;
+    }
+    snprintf(label, sizeof(label), "get_var, %d vars (batch = 1000)", nvars);
+    report(label, t, batches, 1000, "lookups/s");
+
+    /* expansion of a pre-tokenized line with three references */
+    char line[128];
+    snprintf(line, sizeof(line), "echo $v%d ${v%d}x \"$v%d and more\"",
+             nvars - 1, nvars / 2, nvars / 3);
+    tokens_t *proto = tokenize(line);
+    for (int b = 0; b < batches; ++b) {
+        double t0 = now_us();
+        for (int k = 0; k < 1000; ++k) {
+            tokens_t *tk = tokens_share(proto);
+            expand_tokens(tk);
+            free_tokens(tk);
+        }
+        t[b] = now_us() - t0;
+    }
+    snprintf(label, sizeof(label), "expand 3 refs, %d vars (batch = 1000)", nvars);
+    report(label, t, batches, 1000, "lines/s");
+
+    free_tokens(proto);
+    free(names);
+    free(t);
+    free_all_variables();
+}
+
+/* ---------- end-to-end scripts ---------- */
+
+static int write_script(const char *path, const char *body, int repeat, const char *tail) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < repeat; ++i) fputs(body, f);
+    if (tail) fputs(tail, f);
+    return fclose(f);
+}
+
+static void bench_script(const char *shell, const char *label, const char *path) {
+    int n = iters(20);
+    double *t = malloc(sizeof(double) * (size_t)n);
+    if (t == NULL) return;
+    char *argv[] = { (char*)shell, (char*)path, NULL };
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    for (int i = 0; i < n; ++i) {
+        pid_t pid;
+        double t0 = now_us();
+        if (posix_spawn(&pid, shell, &fa, NULL, argv, environ) != 0) {
+            perror(shell);
+            break;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        t[i] = now_us() - t0;
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    report(label, t, n, 1, "runs/s");
+    free(t);
+}
+
+static void bench_scripts(const char *shell) {
+    char dir[] = "/tmp/myshell-bench-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return;
+    }
+    char simple[64], loop[64], external[64];
+    snprintf(simple, sizeof(simple), "%s/simple.sh", dir);
+    snprintf(loop, sizeof(loop), "%s/loop.sh", dir);
+    snprintf(external, sizeof(external), "%s/external.sh", dir);
+
+    write_script(simple, "x=abc\necho $x \"$x\" > /dev/null\ntest -n $x && y=1\n", 1000, NULL);
+    write_script(loop, "for i in 1 2 3 4 5 6 7 8 9 10; do\n", 1,
+                 "  for j in 1 2 3 4 5 6 7 8 9 10 1 2 3 4 5 6 7 8 9 10; do\n"
+                 "    if test $j = 5; then k=$i; else k=$j; fi\n"
+                 "  done\n"
+                 "done\n");
+    write_script(external, "/bin/true\n", 200, NULL);
+
+    bench_script(shell, "script: 3000 builtin lines", simple);
+    bench_script(shell, "script: nested loop, 200 bodies", loop);
+    bench_script(shell, "script: 200 external commands", external);
+
+    unlink(simple);
+    unlink(loop);
+    unlink(external);
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+    const char *shell = argc > 1 ? argv[1] : "bin/myshell";
+    if (argc > 2) scale = atof(argv[2]);
+    if (scale <= 0) scale = 1.0;
+
+    import_environment(environ);
+    printf("bench_suite: scale %.2f, spawn backend from MYSHELL_SPAWN (default posix_spawn)\n", scale);
+    const char *backend = getenv("MYSHELL_SPAWN");
+    if (backend) set_spawn_backend(backend);
+
+    bench_commands();
+    bench_pipe();
+    bench_tokenizer();
+    bench_scripts(shell);
+
+    /* last: each size replaces the whole variable store */
+    free_all_variables();
+    bench_variables(10);
+    bench_variables(1000);
+    bench_variables(100000);
+    return 0;
+}
@@ -1,6 +1,5 @@
 #ifndef SHELL_H
 #define SHELL_H
-#define HISTORY_SIZE 20
 
 #include <stdio.h>
 #include <string.h>
@@ -8,56 +7,273 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <spawn.h>
+#include <time.h>
+#include <stdint.h>
 #include <errno.h>
 
-#define MAX_LEN 512
-#define MAXARGS 10
-#define ARGLEN 30
+extern char **environ;
+
 #define PROMPT "FCIT> "
 
 /* Job support */
-#define MAX_JOBS 64
-#define JOB_CMD_LEN 256
+#define JOB_CMD_LEN 256   /* display length of a job's command line */
 
 typedef struct {
-    pid_t pid;
-    char cmd[JOB_CMD_LEN];
+    int id;          /* stable job number; 0 => free slot */
+    pid_t pid;       /* pid shown to the user (last stage) */
+    pid_t *pids;     /* every process of the pipeline, in stage order; 0 once reaped */
+    int npids;
+    int nlive;       /* processes not yet reaped */
+    int status;      /* wait status of the last stage */
+    char *cmd;
+    struct timespec start;  /* CLOCK_MONOTONIC at add_job */
+    struct rusage usage;    /* summed over reaped processes (ru_maxrss: max) */
+    int fd_read, fd_write;  /* coprocess: the shell's pipe ends, else -1 */
+    char *coproc;           /* coprocess: NAME of its NAME_READ/... variables */
 } job_t;
 
+/* Token arena: all tokens of one line live in chunked storage owned by a
+   tokens_t, with a growable NULL-terminated argv. free_tokens() releases
+   everything at once; strings placed with tokens_strdup() never move. */
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} arena_chunk_t;
+
+typedef struct {
+    char **argv;          /* NULL-terminated token vector */
+    unsigned char *flags; /* TOK_* per token, parallel to argv */
+    int argc;
+    int argv_cap;
+    char **inline_argv;   /* argv slots embedded in the header allocation */
+    arena_chunk_t *chunk; /* newest chunk; older ones follow ->next */
+} tokens_t;
+
+#define TOK_QUOTED  1     /* came from quotes: no field splitting */
+#define TOK_LITERAL 2     /* single quotes: no expansion at all */
+
+/* Script-mode line reader (script.c): mmap for regular files, 64 KiB
+   block reads otherwise; lines are split in place with memchr. */
+typedef struct {
+    int fd;
+    int owns_fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t pos;
+    int mapped;
+    int borrowed;    /* buf belongs to the caller (script_open_string) */
+    int eof;
+    char *tail;      /* copy of a mapped final line lacking '\n' */
+    long lineno;
+} script_reader_t;
+
+script_reader_t* script_open(const char *path);  /* NULL path => stdin */
+script_reader_t* script_open_string(char *text); /* splits text in place */
+char* script_next_line(script_reader_t *r);      /* valid until the next call; NULL at EOF */
+void script_close(script_reader_t *r);
+int script_run(script_reader_t *r);              /* run all commands; status of the last */
+
+/* Persistent history (history.c): numbered entries in a ring backed by an
+   append-only, mmap-loaded file, with a trigram index for substring search. */
+int hist_open(const char *path);          /* NULL => $HISTFILE or ~/.myshell_history */
+void hist_add(const char *line);          /* O(1): ring slot + one append */
+const char* hist_get(long n);             /* entry n, NULL if out of range */
+long hist_first(void);
+long hist_last(void);
+long hist_search(const char *needle, long before); /* newest match below before (0 = any); 0 if none */
+void hist_close(void);
+int history_builtin(char **argv);         /* history [N] | history -s TEXT */
+
+/* Pathname expansion (glob.c): sorted matches of *, ? and [...] words,
+   from per-directory listings cached by path and mtime. */
+int has_glob_meta(const char *s);
+int glob_push(tokens_t *t, const char *pattern, int flags); /* matches pushed; 0 => none */
+
+/* Here-documents (heredoc.c): line readers pass each line through
+   heredoc_collect, which reads the bodies and swaps each `<<WORD`
+   delimiter for a marker; expand_tokens resolves markers to bodies. */
+typedef char* (*line_source_fn)(void *ctx);        /* next malloc'd line, NULL at EOF */
+char* heredoc_collect(const char *line, line_source_fn next, void *ctx); /* NULL if no `<<` */
+const char* heredoc_body(const char *word, int *expand); /* NULL unless word is a marker */
+void heredoc_clear(void);                          /* after the line (or block) has run */
+
 /* Function prototypes */
-char* read_cmd(char* prompt, FILE* fp);
-char** tokenize(char* cmdline);
+tokens_t* tokenize(char* cmdline);                 /* NULL for an empty line */
+void free_tokens(tokens_t *t);
+char* tokens_alloc(tokens_t *t, size_t n);
+char* tokens_strdup(tokens_t *t, const char *s);
+int tokens_push(tokens_t *t, char *tok, int flags);
+tokens_t* tokens_share(const tokens_t *src);       /* new argv over src's strings */
+arena_chunk_t* arena_new_chunk(size_t cap);        /* unlinked chunk, plain malloc */
+void tokens_adopt_chunk(tokens_t *t, arena_chunk_t *c); /* arena takes ownership */
+size_t subst_span(const char *p);                  /* length of a $(...) / `...` at p, else 0 */
+
+/* Redirection operators, with an optional leading fd ("2>", "10<&"):
+   redir_span gives the operator's length at p (0 if none), redir_op
+   classifies a whole token and stores the fd it applies to. */
+typedef enum {
+    REDIR_IN,          /* <    */
+    REDIR_RDWR,        /* <>   */
+    REDIR_OUT,         /* >, >| */
+    REDIR_APPEND,      /* >>   */
+    REDIR_DUP_IN,      /* <&   */
+    REDIR_DUP_OUT,     /* >&   */
+    REDIR_HEREDOC,     /* <<   */
+    REDIR_HERESTR,     /* <<<  */
+    REDIR_OUT_ALL,     /* &>   stdout and stderr */
+    REDIR_APPEND_ALL   /* &>>  */
+} redir_op_t;
+size_t redir_span(const char *p);
+int redir_op(const char *tok, int *fd);            /* a redir_op_t, or -1 if tok is a word */
+
+/* Redirection engine (redir.c): each stage's redirections become an
+   ordered list of fd operations, applied once per process by a forked
+   child, around an in-process builtin, or as posix_spawn file actions. */
+#define REDIR_FD_MAX 1023
+
+typedef enum { RD_OPEN, RD_DUP, RD_CLOSE, RD_HERE } redir_kind_t;
+
+typedef struct {
+    redir_kind_t kind;
+    int fd;            /* the fd being set up */
+    int src;           /* RD_DUP: fd copied onto fd */
+    int oflags;        /* RD_OPEN: open(2) flags */
+    const char *text;  /* RD_OPEN: path; RD_HERE: document text */
+    int add_nl;        /* RD_HERE: here-string, append '\n' */
+} redir_t;
+
+typedef struct {
+    int fd;
+    int copy;          /* saved duplicate, -1 if fd was closed */
+} redir_saved_t;
+
+int redir_parse(const char *op_tok, const char *target, redir_t *out); /* ops added (1-2), -1 on error */
+int redir_apply(const redir_t *r, int n, redir_saved_t *saved, int *nsaved); /* saved NULL => permanent */
+void redir_restore(redir_saved_t *saved, int nsaved);
+int redir_spawn_actions(const redir_t *r, int n, posix_spawn_file_actions_t *fa, int *opened);
+int redir_pump(int in_fd, int out_fd);  /* copy to EOF with splice/sendfile; 0, or -1 on error */
 
 /* executor prototypes:
-   - execute_single: executes a single tokenized command (fork/exec/wait or pipe handling)
-   - execute_chained_input: takes a raw input line and handles semicolon-separated chaining
+   - execute_single: executes a single tokenized command (spawn/wait or pipeline handling)
+                     and returns its exit status (2 on a syntax error, 127 if it could not be started)
+   - execute_command: one raw command without ';'/'&&'/'||': assignment, $var expansion,
+                      builtins, execution; its status becomes $?
+   - execute_chained_input: takes a raw input line and handles ';', '&&' and '||' lists
 */
 int execute_single(char** arglist);
+int execute_async(char** arglist);          /* start as a job, no notice; returns job id or -1 */
+int execute_coproc(const char *name, char** arglist); /* `coproc NAME cmd`; job id or -1 */
+int execute_timed(char** arglist);          /* execute_single + resource report (`time cmd`) */
+int run_timed(int (*run)(void *arg), void *arg); /* run(arg) + the same report; returns its status */
+void execute_note_usage(const struct rusage *ru); /* a reaped foreground child, for `time` */
+int execute_command(char* cmd);
+int execute_tokens(tokens_t *toks);         /* execute_command on pre-tokenized input */
+void expand_tokens(tokens_t *toks);         /* $var, $(cmd), here-documents; argv may move */
+int execute_command_async(char* cmd);       /* execute_command + execute_async */
 int execute_chained_input(char* input_line);
+void execute_set_piped_output(int on);     /* stdout feeds the next piece of a compound pipeline */
+void child_reset_signals(void);            /* call first in any forked child */
+
+/* and-or list separators, as found by find_list_op ('\n' counts as ';') */
+typedef enum { LIST_SEQ, LIST_AND, LIST_OR, LIST_END } list_op_t;
+char* find_list_op(const char *p, list_op_t *op);
+int list_op_len(list_op_t op);                     /* bytes the separator occupies */
+int get_last_status(void);                  /* $? */
+void set_last_status(int status);
+
+/* Process launch backend used by execute_single (selected with the
+   'spawn' builtin or the MYSHELL_SPAWN environment variable). */
+typedef enum { SPAWN_POSIX, SPAWN_FORK } spawn_backend_t;
+int set_spawn_backend(const char *name);   /* "fork" or "posix_spawn"; 0 on success, -1 if unknown */
+const char* get_spawn_backend(void);
+
+/* Capacity of the pipes between pipeline stages (the 'pipesize' builtin
+   or MYSHELL_PIPESIZE): "default" (the kernel's 64 KiB), "max"
+   (/proc/sys/fs/pipe-max-size) or a byte count with an optional K/M
+   suffix, capped at the maximum. */
+int set_pipe_size(const char *spec);       /* 0 on success, -1 if spec is invalid */
+long get_pipe_size(void);                  /* bytes requested, 0 for the default */
+
+/* Command path cache (pathhash.c): name -> absolute path, invalidated
+   automatically when PATH changes. */
+const char* path_cache_lookup(const char *name); /* NULL if name has '/' or is not on PATH */
+void path_cache_forget(const char *name);
+void path_cache_clear(void);
+int hash_builtin(char **arglist);                /* 'hash' builtin; returns exit status */
 
 /* Job manager prototypes
-   add_job now returns the job index (1-based) on success, -1 on failure.
+   add_job records every pid of a pipeline and returns its stable job
+   number (1-based) on success, -1 on failure.
 */
-int add_job(pid_t pid, const char *cmd);
+int add_job(const pid_t *pids, int npids, const char *cmd);
 void remove_job(pid_t pid);
-void print_jobs(void);
+void job_attach_coproc(int id, const char *name, int fd_read, int fd_write); /* fds closed, vars unset with the job */
+const job_t* find_job(int id);      /* NULL if no live job has this id */
+void print_jobs(int long_format);   /* long_format: pids, state and resource usage */
+int jobs_active(void);   /* number of live background jobs */
 void reap_zombies(void); /* reap finished background children (WNOHANG) */
+int job_note_exit(pid_t pid, int status, const struct rusage *ru, job_t *finished); /* job id when the job finished, 0 if still running, -1 if untracked */
+void print_job_done(const job_t *j);
+void rusage_add(struct rusage *acc, const struct rusage *ru);   /* sums; ru_maxrss is the max */
+double elapsed_since(const struct timespec *start);              /* seconds, CLOCK_MONOTONIC */
+void print_time_report(double real, const struct rusage *ru);    /* `time` output on stderr */
 
-/* NEW: handle built-in commands.
-   Returns 1 if builtin handled, 0 otherwise */
-int handle_builtin(char** arglist);
+/* Execution trace (trace.c): with MYSHELL_TRACE_FD=n or --trace-fd=n
+   every command becomes one JSON line on fd n with per-phase monotonic
+   timestamps. Probes are trace_start()/trace_stop() pairs; while tracing
+   is off trace_start() returns 0 without reading the clock. */
+enum { TR_TOKENIZE, TR_EXPAND, TR_PATH, TR_SPAWN, TR_REDIRECT, TR_BUILTIN, TR_WAIT, TR_NPHASES };
+extern int trace_fd;               /* -1 => tracing off */
+int trace_open(const char *spec);  /* enable on fd "n"; -1 if not an open fd */
+uint64_t trace_now(void);
+void trace_phase(int phase, uint64_t t0);
+void trace_command(char **argv, int status);   /* flush the current command's line */
+void trace_reap(uint64_t t0, int reaped);
 
-/* NEW: handle_if_then_else parses & executes a collected if-then-else-fi block.
-   It takes the full multiline block as a single string (with newlines) and
-   returns 1 if it handled the block, 0 otherwise.
-*/
-int handle_if_then_else(char *cmdline);
+static inline uint64_t trace_start(void) {
+    return trace_fd < 0 ? 0 : trace_now();
+}
+
+static inline void trace_stop(int phase, uint64_t t0) {
+    if (t0 != 0) trace_phase(phase, t0);
+}
+
+/* Builtins (builtins.c): int fn(argv) returning an exit status.
+   find_builtin returns NULL for non-builtins. execute_single runs them
+   in-process (fds saved/restored around '<'/'>') or, as a pipeline
+   stage or background job, in a forked child. */
+typedef int (*builtin_fn)(char **argv);
+builtin_fn find_builtin(const char *name);
+builtin_fn find_pure_builtin(const char *name); /* only builtins that leave shell state alone */
+void builtins_set_interactive(void);  /* `exit` says goodbye only in this process */
+
+/* Compound commands (compound.c): if/then/elif/else/fi, while/until and
+   for ... in ... do ... done, nestable and mixed with plain commands.
+   run_compound parses the whole text once into a command tree (every
+   simple command tokenized once) and runs it; it returns 0 without
+   touching text if no compound keyword starts a command. compound_depth
+   is the number of blocks text leaves open, for multi-line input. */
+int run_compound(char *text);
+int compound_depth(const char *text);
+int loop_control(int is_continue, int levels);     /* break/continue; -1 outside a loop */
 
 /* ===================== Shell variable API ===================== */
-/* Simple key/value variable store used by Feature-8. */
+/* Hash-table key/value variable store used by Feature-8, with an export
+   attribute. The environment is imported at startup as exported vars. */
 int set_var(const char *name, const char *value); /* returns 0 on success, -1 on error */
 const char* get_var(const char *name);            /* returns pointer to internal value or NULL */
+int unset_var(const char *name);                  /* 0 if it existed, -1 if not */
+int export_var(const char *name, const char *value); /* value may be NULL (keep current) */
+int is_valid_name(const char *name);              /* [A-Za-z_][A-Za-z0-9_]* */
+void import_environment(char **envp);
+char** get_exported_env(void);                    /* cached envp, rebuilt only after export changes */
 void print_all_variables(void);                   /* prints name=value lines */
+void print_exported_variables(void);              /* prints export name=value lines */
 void free_all_variables(void);                    /* free memory on exit */
 /* ============================================================= */
 
@@ -0,0 +1,761 @@
+/* src/builtins.c
+ * Builtin commands and their dispatch table.
+ *
+ * Each builtin is `int fn(char **argv)` returning an exit status. The
+ * executor looks builtins up with find_builtin() and runs them in the
+ * shell process (with '<'/'>' applied by saving and restoring fds), or in
+ * a forked child when they are a pipeline stage or run in the background.
+ * Output goes through stdio, so callers flush stdout around them.
+ */
+
+#include "shell.h"
+#include <ctype.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/pidfd.h>
+#include <poll.h>
+
+/* ------------------- shell builtins ------------------- */
+
+/* The interactive shell's pid; scripts, -c and forked children exit
+   without a farewell line in their output */
+static pid_t interactive_pid = -1;
+
+void builtins_set_interactive(void) {
+    interactive_pid = getpid();
+}
+
+static int bi_exit(char **argv) {
+    int code = argv[1] ? atoi(argv[1]) : 0;
+    /* cleanup variables before exit */
+    free_all_variables();
+    if (getpid() == interactive_pid) printf("Exiting shell...\n");
+    exit(code);
+}
+
+static int bi_cd(char **argv) {
+    const char *targetDir = argv[1];
+    if (targetDir == NULL) {
+        targetDir = get_var("HOME");
+        if (targetDir == NULL) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+    }
+    if (chdir(targetDir) != 0) {
+        perror("cd");
+        return 1;
+    }
+    return 0;
+}
+
+static int bi_help(char **argv) {
+    (void)argv;
+    printf("Built-in commands:\n");
+    printf("  cd <dir>    - change directory\n");
+    printf("  exit [n]    - exit the shell\n");
+    printf("  help        - show this message\n");
+    printf("  jobs [-l]   - list background jobs (-l: pids, wall time, CPU, max RSS)\n");
+    printf("  coproc NAME cmd - run cmd as a job wired to the shell: >&$NAME_WRITE, <&$NAME_READ, $NAME_PID\n");
+    printf("  time cmd    - run cmd, then report real/user/sys time, max RSS and context switches\n");
+    printf("  history [N] | history -s text - list entries, or search them; !n recalls entry n\n");
+    printf("  if ... then ... [elif ...] [else ...] fi - conditional\n");
+    printf("  for x in words; do ...; done, while|until cmd; do ...; done, break [n], continue [n]\n");
+    printf("  set         - print defined shell variables (name=value)\n");
+    printf("  export [NAME[=value]] - mark variables for the environment of commands\n");
+    printf("  spawn [fork|posix_spawn] - show or select the process launch backend\n");
+    printf("  pipesize [default|max|N] - show or set the capacity of pipeline pipes\n");
+    printf("  hash [-r|-s|name...] - list, clear, show stats of, or add cached command paths\n");
+    printf("  echo [-n] [-e] args, printf fmt args, test / [ expr ], true, false,\n");
+    printf("  read [-r] [name...] - run in-process, no fork\n");
+    printf("  parallel [-j N] [cmd...] - run commands (or stdin lines) with at most N at once\n");
+    return 0;
+}
+
+/* jobs [-l]: -l adds pids, wall time and resource usage */
+static int bi_jobs(char **argv) {
+    int long_format = 0;
+    for (int i = 1; argv[i] != NULL; ++i) {
+        if (strcmp(argv[i], "-l") == 0) {
+            long_format = 1;
+        } else {
+            fprintf(stderr, "jobs: usage: jobs [-l]\n");
+            return 2;
+        }
+    }
+    print_jobs(long_format);
+    return 0;
+}
+
+/* coproc NAME CMD...: start CMD as a job wired to the shell both ways */
+static int bi_coproc(char **argv) {
+    if (argv[1] == NULL || argv[2] == NULL || !is_valid_name(argv[1])) {
+        fprintf(stderr, "coproc: usage: coproc NAME command [args...]\n");
+        return 2;
+    }
+    return execute_coproc(argv[1], argv + 2) < 0 ? 1 : 0;
+}
+
+/* time CMD...: run CMD and report its wall time and resource usage.
+   Normally caught as a prefix by execute_tokens so it covers a whole
+   pipeline; this entry serves `time` as a pipeline stage. */
+static int bi_time(char **argv) {
+    return execute_timed(argv + 1);
+}
+
+static int bi_set(char **argv) {
+    (void)argv;
+    print_all_variables();   // prints name=value
+    return 0;
+}
+
+/* export: NAME=value, NAME, or no args to list */
+static int bi_export(char **argv) {
+    if (argv[1] == NULL) {
+        print_exported_variables();
+        return 0;
+    }
+    int rc = 0;
+    for (int i = 1; argv[i] != NULL; ++i) {
+        char *eq = strchr(argv[i], '=');
+        if (eq != NULL) *eq = '\0';
+        if (!is_valid_name(argv[i])) {
+            if (eq != NULL) *eq = '=';
+            fprintf(stderr, "export: '%s': not a valid identifier\n", argv[i]);
+            rc = 1;
+            continue;
+        }
+        export_var(argv[i], eq ? eq + 1 : NULL);
+        if (eq != NULL) *eq = '=';
+    }
+    return rc;
+}
+
+/* spawn: show or select the launch backend used by execute_single */
+static int bi_spawn(char **argv) {
+    if (argv[1] == NULL) {
+        printf("%s\n", get_spawn_backend());
+        return 0;
+    }
+    if (set_spawn_backend(argv[1]) != 0) {
+        fprintf(stderr, "spawn: unknown backend '%s' (use fork or posix_spawn)\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+/* pipesize: show or set the pipe capacity used between pipeline stages */
+static int bi_pipesize(char **argv) {
+    if (argv[1] == NULL) {
+        long n = get_pipe_size();
+        if (n == 0) printf("default\n");
+        else printf("%ld\n", n);
+        return 0;
+    }
+    if (set_pipe_size(argv[1]) != 0) {
+        fprintf(stderr, "pipesize: invalid size '%s' (use default, max or bytes[K|M])\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+static int bi_true(char **argv)  { (void)argv; return 0; }
+static int bi_false(char **argv) { (void)argv; return 1; }
+
+/* break [n] / continue [n]: the loop runner in compound.c unwinds */
+static int loop_builtin(char **argv, int is_continue) {
+    int levels = 1;
+    if (argv[1] != NULL) {
+        char *end;
+        long n = strtol(argv[1], &end, 10);
+        if (*end != '\0' || n < 1) {
+            fprintf(stderr, "%s: %s: loop count out of range\n", argv[0], argv[1]);
+            return 1;
+        }
+        levels = n > 1000 ? 1000 : (int)n;
+    }
+    if (loop_control(is_continue, levels) != 0) {
+        fprintf(stderr, "%s: only meaningful in a loop\n", argv[0]);
+        return 0;
+    }
+    return 0;
+}
+
+static int bi_break(char **argv)    { return loop_builtin(argv, 0); }
+static int bi_continue(char **argv) { return loop_builtin(argv, 1); }
+
+/* ------------------- echo / printf ------------------- */
+
+/* Write the backslash escape at *sp (just past the '\'), advancing *sp.
+   Returns 1 if the escape was \c (stop all output). */
+static int put_escape(const char **sp) {
+    const char *s = *sp;
+    int c = *s ? *s++ : '\\';
+    switch (c) {
+    case 'n': putchar('\n'); break;
+    case 't': putchar('\t'); break;
+    case 'r': putchar('\r'); break;
+    case 'a': putchar('\a'); break;
+    case 'b': putchar('\b'); break;
+    case 'f': putchar('\f'); break;
+    case 'v': putchar('\v'); break;
+    case '\\': putchar('\\'); break;
+    case 'c': *sp = s; return 1;
+    case '0': {
+        int v = 0;
+        for (int k = 0; k < 3 && *s >= '0' && *s <= '7'; ++k) v = v * 8 + (*s++ - '0');
+        putchar(v);
+        break;
+    }
+    default: putchar('\\'); putchar(c); break;
+    }
+    *sp = s;
+    return 0;
+}
+
+static int bi_echo(char **argv) {
+    int newline = 1, escapes = 0, i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i) {
+        const char *f = argv[i] + 1;
+        if (strspn(f, "neE") != strlen(f)) break;
+        for (; *f; ++f) {
+            if (*f == 'n') newline = 0;
+            else if (*f == 'e') escapes = 1;
+            else escapes = 0;
+        }
+    }
+    for (int first = 1; argv[i]; ++i, first = 0) {
+        if (!first) putchar(' ');
+        if (!escapes) {
+            fputs(argv[i], stdout);
+            continue;
+        }
+        for (const char *s = argv[i]; *s; ) {
+            if (*s != '\\') { putchar(*s++); continue; }
+            ++s;
+            if (put_escape(&s)) return 0;
+        }
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+/* printf FORMAT [ARG...]: %s %b %c %d %i %u %o %x %X %% with flags,
+   width and precision; the format is reused while arguments remain. */
+static int bi_printf(char **argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char *fmt = argv[1];
+    char **args = argv + 2;
+    int rc = 0;
+
+    do {
+        int consumed = 0;
+        for (const char *f = fmt; *f; ) {
+            if (*f == '\\') {
+                ++f;
+                if (put_escape(&f)) return rc;
+                continue;
+            }
+            if (*f != '%') { putchar(*f++); continue; }
+            if (f[1] == '%') { putchar('%'); f += 2; continue; }
+
+            /* copy one conversion spec: %[flags][width][.prec]conv */
+            char spec[32];
+            size_t n = 0;
+            spec[n++] = *f++;
+            while (*f && strchr("-+ #0123456789.", *f) && n < sizeof(spec) - 4) spec[n++] = *f++;
+            char conv = *f ? *f++ : 's';
+            const char *arg = *args ? *args++ : NULL;
+            if (arg) consumed = 1;
+
+            if (strchr("diouxX", conv)) {
+                char *end;
+                long long v = 0;
+                if (arg && *arg) {
+                    v = (arg[0] == '\'' || arg[0] == '"') ? (unsigned char)arg[1] : strtoll(arg, &end, 0);
+                    if (!(arg[0] == '\'' || arg[0] == '"') && *end) {
+                        fprintf(stderr, "printf: %s: invalid number\n", arg);
+                        rc = 1;
+                    }
+                }
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+                printf(spec, v);
+            } else if (conv == 'c') {
+                spec[n++] = 'c'; spec[n] = '\0';
+                printf(spec, arg ? arg[0] : '\0');
+            } else if (conv == 'b') {
+                for (const char *s = arg ? arg : ""; *s; ) {
+                    if (*s != '\\') { putchar(*s++); continue; }
+                    ++s;
+                    if (put_escape(&s)) return rc;
+                }
+            } else {
+                spec[n++] = 's'; spec[n] = '\0';
+                printf(spec, arg ? arg : "");
+            }
+        }
+        if (!consumed) break;
+    } while (*args);
+    return rc;
+}
+
+/* ------------------- test / [ ------------------- */
+
+typedef struct {
+    char **av;
+    int pos;
+    int end;
+    int err;
+} test_ctx_t;
+
+static int test_expr(test_ctx_t *t);
+
+static int test_unary(const char *op, const char *arg) {
+    struct stat sb;
+    switch (op[1]) {
+    case 'z': return arg[0] == '\0';
+    case 'n': return arg[0] != '\0';
+    case 'e': return stat(arg, &sb) == 0;
+    case 'f': return stat(arg, &sb) == 0 && S_ISREG(sb.st_mode);
+    case 'd': return stat(arg, &sb) == 0 && S_ISDIR(sb.st_mode);
+    case 's': return stat(arg, &sb) == 0 && sb.st_size > 0;
+    case 'L':
+    case 'h': return lstat(arg, &sb) == 0 && S_ISLNK(sb.st_mode);
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    }
+    return -1;
+}
+
+static int is_unary_op(const char *s) {
+    return s[0] == '-' && s[1] && !s[2] && strchr("znefdsLhrwx", s[1]);
+}
+
+static int test_int(test_ctx_t *t, const char *s, long long *out) {
+    char *end;
+    errno = 0;
+    *out = strtoll(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        t->err = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int test_binary(test_ctx_t *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    long long x, y;
+    if (test_int(t, a, &x) || test_int(t, b, &y)) return 0;
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    if (strcmp(op, "-ge") == 0) return x >= y;
+    return -1;
+}
+
+static int is_binary_op(const char *s) {
+    static const char *ops[] = { "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL };
+    for (int i = 0; ops[i]; ++i) if (strcmp(s, ops[i]) == 0) return 1;
+    return 0;
+}
+
+static int test_primary(test_ctx_t *t) {
+    if (t->pos >= t->end) { t->err = 1; return 0; }
+    char *a = t->av[t->pos];
+
+    if (strcmp(a, "!") == 0) {
+        t->pos++;
+        return !test_primary(t);
+    }
+    if (strcmp(a, "(") == 0) {
+        t->pos++;
+        int v = test_expr(t);
+        if (t->pos >= t->end || strcmp(t->av[t->pos], ")") != 0) { t->err = 1; return 0; }
+        t->pos++;
+        return v;
+    }
+    if (t->pos + 2 < t->end && is_binary_op(t->av[t->pos + 1])) {
+        int v = test_binary(t, a, t->av[t->pos + 1], t->av[t->pos + 2]);
+        t->pos += 3;
+        return v;
+    }
+    if (is_unary_op(a) && t->pos + 1 < t->end) {
+        int v = test_unary(a, t->av[t->pos + 1]);
+        t->pos += 2;
+        return v;
+    }
+    t->pos++;
+    return a[0] != '\0';
+}
+
+static int test_and(test_ctx_t *t) {
+    int v = test_primary(t);
+    while (t->pos < t->end && strcmp(t->av[t->pos], "-a") == 0) {
+        t->pos++;
+        int r = test_primary(t);
+        v = v && r;
+    }
+    return v;
+}
+
+static int test_expr(test_ctx_t *t) {
+    int v = test_and(t);
+    while (t->pos < t->end && strcmp(t->av[t->pos], "-o") == 0) {
+        t->pos++;
+        int r = test_and(t);
+        v = v || r;
+    }
+    return v;
+}
+
+/* test EXPR / [ EXPR ]: 0 true, 1 false, 2 on syntax error */
+static int bi_test(char **argv) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+    if (strcmp(argv[0], "[") == 0) {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    if (argc == 1) return 1;
+
+    test_ctx_t t = { argv, 1, argc, 0 };
+    int v = test_expr(&t);
+    if (t.err || t.pos != t.end) {
+        if (!t.err) fprintf(stderr, "%s: syntax error\n", argv[0]);
+        return 2;
+    }
+    return v ? 0 : 1;
+}
+
+/* ------------------- read ------------------- */
+
+/* Read one line from fd 0 without reading past it, so the rest of the
+   input is left for whoever reads next. Seekable input is read in blocks
+   and the excess handed back with lseek; pipes/ttys go byte by byte. */
+static char* read_line_fd0(int *got_eof) {
+    size_t cap = 256, len = 0;
+    char *buf = malloc(cap);
+    if (buf == NULL) return NULL;
+    int seekable = lseek(STDIN_FILENO, 0, SEEK_CUR) != -1;
+    *got_eof = 0;
+
+    while (1) {
+        if (cap - len < 129) {
+            char *nb = realloc(buf, cap * 2);
+            if (nb == NULL) { free(buf); return NULL; }
+            buf = nb;
+            cap *= 2;
+        }
+        ssize_t n = read(STDIN_FILENO, buf + len, seekable ? 128 : 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { *got_eof = 1; break; }
+        char *nl = memchr(buf + len, '\n', (size_t)n);
+        if (nl != NULL) {
+            size_t keep = (size_t)(nl - (buf + len));
+            if (seekable) lseek(STDIN_FILENO, -(off_t)((size_t)n - keep - 1), SEEK_CUR);
+            len += keep;
+            break;
+        }
+        len += (size_t)n;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+/* read [-r] [NAME...]: split on blanks; the last NAME takes the rest.
+   Without NAMEs the line goes to REPLY. Status 1 at end of input. */
+static int bi_read(char **argv) {
+    int raw = 0, i = 1;
+    if (argv[i] && strcmp(argv[i], "-r") == 0) { raw = 1; i++; }
+
+    int eof;
+    char *line = read_line_fd0(&eof);
+    if (line == NULL) return 1;
+    int status = (eof && line[0] == '\0') ? 1 : 0;
+
+    if (!raw) {   /* drop backslashes, keeping the escaped character */
+        char *w = line;
+        for (char *r = line; *r; ++r) {
+            if (*r == '\\' && r[1]) ++r;
+            *w++ = *r;
+        }
+        *w = '\0';
+    }
+
+    if (argv[i] == NULL) {
+        set_var("REPLY", line);
+        free(line);
+        return status;
+    }
+
+    char *p = line;
+    for (; argv[i]; ++i) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (argv[i + 1] == NULL) {
+            char *end = p + strlen(p);
+            while (end > p && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+            set_var(argv[i], p);
+            break;
+        }
+        char *word = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (*p) *p++ = '\0';
+        set_var(argv[i], word);
+    }
+    free(line);
+    return status;
+}
+
+/* ------------------- parallel ------------------- */
+
+typedef struct {
+    int jid;     /* job id while running, 0 => free */
+    int seq;     /* 1-based position in the command list */
+    int npids;
+    pid_t *pids; /* the job's processes, 0 once reaped */
+    int *pidfds; /* pidfd per process, -1 if none could be opened */
+} par_slot_t;
+
+/* Take over job jid's processes into slot, with a pidfd for each so the
+   wait can be limited to them. Returns 0, or -1 if out of memory. */
+static int par_slot_fill(par_slot_t *slot, int jid, int seq) {
+    const job_t *j = find_job(jid);
+    if (j == NULL) return -1;
+    slot->pids = malloc(sizeof(pid_t) * (size_t)j->npids);
+    slot->pidfds = malloc(sizeof(int) * (size_t)j->npids);
+    if (slot->pids == NULL || slot->pidfds == NULL) {
+        free(slot->pids);
+        free(slot->pidfds);
+        return -1;
+    }
+    slot->npids = j->npids;
+    memcpy(slot->pids, j->pids, sizeof(pid_t) * (size_t)j->npids);
+    for (int k = 0; k < slot->npids; ++k)
+        slot->pidfds[k] = pidfd_open(slot->pids[k], 0);
+    slot->jid = jid;
+    slot->seq = seq;
+    return 0;
+}
+
+static void par_slot_clear(par_slot_t *slot) {
+    for (int k = 0; k < slot->npids; ++k)
+        if (slot->pidfds[k] >= 0) close(slot->pidfds[k]);
+    free(slot->pids);
+    free(slot->pidfds);
+    memset(slot, 0, sizeof(*slot));
+}
+
+/* Mark pid reaped if it is one of slot's processes; 1 if it was */
+static int par_slot_reaped(par_slot_t *slot, pid_t pid) {
+    for (int k = 0; k < slot->npids; ++k) {
+        if (slot->pids[k] != pid) continue;
+        slot->pids[k] = 0;
+        if (slot->pidfds[k] >= 0) close(slot->pidfds[k]);
+        slot->pidfds[k] = -1;
+        return 1;
+    }
+    return 0;
+}
+
+/* Block until one of the slots' processes exits, and reap only that one:
+   other children (earlier background jobs) are left for reap_zombies.
+   Returns the pid reaped with its status and usage, or -1. */
+static pid_t par_wait(par_slot_t *slots, int n, int *status, struct rusage *ru) {
+    int npoll = 0;
+    for (int i = 0; i < n; ++i) npoll += slots[i].npids;
+    struct pollfd *pfd = malloc(sizeof(struct pollfd) * (size_t)npoll);
+    pid_t *owner = malloc(sizeof(pid_t) * (size_t)npoll);
+    pid_t fallback = 0;   /* a process without a pidfd: wait for it directly */
+    pid_t pid = -1;
+    if (pfd == NULL || owner == NULL) {
+        perror("malloc");
+        goto out;
+    }
+    npoll = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < slots[i].npids; ++k) {
+            if (slots[i].pids[k] == 0) continue;
+            if (slots[i].pidfds[k] < 0) {
+                if (fallback == 0) fallback = slots[i].pids[k];
+                continue;
+            }
+            pfd[npoll].fd = slots[i].pidfds[k];
+            pfd[npoll].events = POLLIN;
+            owner[npoll++] = slots[i].pids[k];
+        }
+    }
+
+    pid_t ready = fallback;
+    while (ready == 0 && npoll > 0) {
+        if (poll(pfd, (nfds_t)npoll, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("parallel: poll");
+            goto out;
+        }
+        for (int k = 0; k < npoll && ready == 0; ++k)
+            if (pfd[k].revents) ready = owner[k];
+    }
+    if (ready == 0) goto out;
+    while ((pid = wait4(ready, status, 0, ru)) < 0 && errno == EINTR)
+        ;
+    if (pid < 0) perror("parallel: wait4");
+
+out:
+    free(pfd);
+    free(owner);
+    return pid;
+}
+
+/* parallel [-j N] [COMMAND...]: run each COMMAND (or, with none given,
+   each line of stdin) as a job from the job table, keeping at most N
+   (default: online CPUs) running. A slot is refilled as soon as one of
+   its children is reaped, and each command's exit status is reported as
+   it finishes. Returns the number of failed commands (max 255). */
+static int bi_parallel(char **argv) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    if (argv[i] && strncmp(argv[i], "-j", 2) == 0) {
+        const char *v = argv[i][2] ? argv[i] + 2 : argv[++i];
+        char *end;
+        n = v ? strtol(v, &end, 10) : 0;
+        if (v == NULL || *end != '\0' || n < 1) {
+            fprintf(stderr, "parallel: -j: expected a positive number\n");
+            return 2;
+        }
+        i++;
+    }
+    if (n < 1) n = 1;
+
+    char **cmds = argv + i;
+    script_reader_t *in = NULL;
+    if (cmds[0] == NULL && (in = script_open(NULL)) == NULL) return 2;
+
+    par_slot_t *slots = calloc((size_t)n, sizeof(par_slot_t));
+    if (slots == NULL) {
+        perror("calloc");
+        script_close(in);
+        return 2;
+    }
+
+    int running = 0, seq = 0, failures = 0, more = 1;
+    while (more || running > 0) {
+        /* fill free slots */
+        while (more && running < n) {
+            char *line = in ? script_next_line(in) : *cmds;
+            if (line == NULL) { more = 0; break; }
+            if (!in) cmds++;
+            while (*line == ' ' || *line == '\t') line++;
+            if (*line == '\0' || *line == '#') continue;
+
+            seq++;
+            int jid = execute_command_async(line);
+            if (jid < 0) {
+                printf("[parallel] #%d failed to start: %s\n", seq, line);
+                fflush(stdout);
+                failures++;
+                continue;
+            }
+            int k = 0;
+            while (slots[k].jid != 0) k++;
+            if (par_slot_fill(&slots[k], jid, seq) != 0) {
+                perror("parallel");
+                break;
+            }
+            running++;
+        }
+        if (running == 0) continue;
+
+        /* wait for one of our processes; background jobs started before
+           keep their statuses for reap_zombies */
+        int status;
+        struct rusage ru;
+        pid_t pid = par_wait(slots, (int)n, &status, &ru);
+        if (pid < 0) break;
+        int k = 0;
+        while (k < n && !par_slot_reaped(&slots[k], pid)) k++;
+        job_t done;
+        if (job_note_exit(pid, status, &ru, &done) <= 0) continue;
+
+        int code = WIFEXITED(done.status) ? WEXITSTATUS(done.status)
+                                          : 128 + WTERMSIG(done.status);
+        printf("[parallel] #%d exit %d: %s\n", slots[k].seq, code, done.cmd);
+        fflush(stdout);
+        if (code != 0) failures++;
+        par_slot_clear(&slots[k]);
+        running--;
+        free(done.cmd);
+    }
+
+    for (int k = 0; k < n; ++k)
+        if (slots[k].jid != 0) par_slot_clear(&slots[k]);
+    free(slots);
+    script_close(in);
+    return failures > 255 ? 255 : failures;
+}
+
+/* ------------------- dispatch table ------------------- */
+
+typedef struct {
+    const char *name;
+    builtin_fn fn;
+    int pure;   /* only writes output: safe to run in-process for $(...) */
+} builtin_t;
+
+/* kept sorted by name for bsearch */
+static const builtin_t builtins[] = {
+    { "[",      bi_test,   1 },
+    { "break",  bi_break,  0 },
+    { "cd",     bi_cd,     0 },
+    { "continue", bi_continue, 0 },
+    { "coproc", bi_coproc, 0 },
+    { "echo",   bi_echo,   1 },
+    { "exit",   bi_exit,   0 },
+    { "export", bi_export, 0 },
+    { "false",  bi_false,  1 },
+    { "hash",   hash_builtin, 0 },
+    { "help",   bi_help,   1 },
+    { "history", history_builtin, 1 },
+    { "jobs",   bi_jobs,   1 },
+    { "parallel", bi_parallel, 0 },
+    { "pipesize", bi_pipesize, 0 },
+    { "printf", bi_printf, 1 },
+    { "read",   bi_read,   0 },
+    { "set",    bi_set,    1 },
+    { "spawn",  bi_spawn,  0 },
+    { "test",   bi_test,   1 },
+    { "time",   bi_time,   0 },
+    { "true",   bi_true,   1 },
+};
+
+static int cmp_builtin(const void *key, const void *elem) {
+    return strcmp((const char*)key, ((const builtin_t*)elem)->name);
+}
+
+static const builtin_t* lookup_builtin(const char *name) {
+    if (name == NULL) return NULL;
+    return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]),
+                   sizeof(builtin_t), cmp_builtin);
+}
+
+builtin_fn find_builtin(const char *name) {
+    const builtin_t *b = lookup_builtin(name);
+    return b ? b->fn : NULL;
+}
+
+/* Builtins a command substitution may run in the shell itself: they
+   change no variables, jobs, cwd or exit state. */
+builtin_fn find_pure_builtin(const char *name) {
+    const builtin_t *b = lookup_builtin(name);
+    return b && b->pure ? b->fn : NULL;
+}
@@ -0,0 +1,764 @@
+/* src/compound.c
+ * Compound commands: if/elif/else/fi, while/until ... do ... done and
+ * for NAME in WORDS; do ... done, nestable and mixed with plain commands.
+ *
+ * The text is split once into segments (on ';' and newlines, keeping
+ * '&&'/'||' lists together, with leading keywords split off), parsed
+ * into a tree, and every simple command in it is tokenized right then.
+ * Running a node re-expands its pre-tokenized words (tokens_share) and
+ * goes through execute_tokens, so a loop body is never re-tokenized and
+ * builtins in it run in the shell without forking.
+ *
+ * "done"/"fi" may be followed by redirections, applied around the whole
+ * command ("while read l; do ...; done < file"), and a compound command
+ * may be a pipeline stage ("cat f | while read l; ...; done | sort").
+ * A pipeline splits into pieces at each '|' that starts or ends a
+ * compound command; every piece runs in a forked child, as in sh.
+ *
+ * A leading "time" before a compound command (or a pipeline starting
+ * with one) is a keyword here, timing the whole command; before a
+ * simple command it stays the prefix execute_tokens handles.
+ */
+
+#define _GNU_SOURCE  /* pipe2 */
+#include "shell.h"
+#include <fcntl.h>
+
+enum {
+    K_NONE, K_IF, K_THEN, K_ELIF, K_ELSE, K_FI,
+    K_FOR, K_WHILE, K_UNTIL, K_DO, K_DONE, K_TIME
+};
+
+#define KW(k) (1u << (k))
+
+typedef struct {
+    char *text;   /* command text (K_NONE), "NAME in ..." (K_FOR), redirections (K_FI, K_DONE) */
+    int kw;
+    int piped;    /* a '|' follows: the next segment starts the next pipeline piece */
+} seg_t;
+
+enum { N_LIST, N_IF, N_WHILE, N_UNTIL, N_FOR, N_PIPE, N_TIME };
+
+typedef struct node {
+    int kind;
+    struct node *next;
+    /* N_LIST: an and-or list */
+    int ncmds;
+    tokens_t **cmds;
+    list_op_t *ops;          /* ops[i]: how cmds[i] follows cmds[i-1] */
+    /* N_IF, N_WHILE, N_UNTIL, N_FOR; N_PIPE keeps its pieces in body,
+       N_TIME the command it times */
+    struct node *cond;
+    struct node *body;
+    struct node *alt;        /* else / elif branch */
+    char *var;               /* N_FOR */
+    tokens_t *words;         /* N_FOR; NULL without 'in' */
+    tokens_t *redir_words;   /* compound: redirections after fi/done */
+} node_t;
+
+static int opens_block(int kw);
+
+/* Keyword starting the segment [s, end), if any; *rest gets the text
+   after it (for fi/done, redirections and a '|' may follow). "time" is
+   one only when a compound command follows it. */
+static int keyword_at(const char *s, const char *end, const char **rest) {
+    static const struct { const char *word; int kw; } kws[] = {
+        { "if", K_IF }, { "then", K_THEN }, { "elif", K_ELIF }, { "else", K_ELSE },
+        { "fi", K_FI }, { "for", K_FOR }, { "while", K_WHILE }, { "until", K_UNTIL },
+        { "do", K_DO }, { "done", K_DONE },
+    };
+    for (size_t i = 0; i < sizeof(kws) / sizeof(kws[0]); ++i) {
+        size_t n = strlen(kws[i].word);
+        if ((size_t)(end - s) < n || strncmp(s, kws[i].word, n) != 0) continue;
+        const char *r = s + n;
+        if (r != end && *r != ' ' && *r != '\t') continue;
+        while (r != end && (*r == ' ' || *r == '\t')) r++;
+        *rest = r;
+        return kws[i].kw;
+    }
+    const char *after;
+    if ((size_t)(end - s) > 5 && strncmp(s, "time", 4) == 0 && (s[4] == ' ' || s[4] == '\t')) {
+        const char *r = s + 5;
+        while (r != end && (*r == ' ' || *r == '\t')) r++;
+        if (opens_block(keyword_at(r, end, &after))) {
+            *rest = r;
+            return K_TIME;
+        }
+    }
+    return K_NONE;
+}
+
+/* End of the segment starting at p: the next ';' or newline outside
+   quotes ('&&'/'||' lists stay together). */
+static char* segment_end(const char *p, list_op_t *op) {
+    char *e = find_list_op(p, op);
+    while (*op == LIST_AND || *op == LIST_OR)
+        e = find_list_op(e + 2, op);
+    return e;
+}
+
+static int opens_block(int kw) {
+    return kw == K_IF || kw == K_WHILE || kw == K_UNTIL || kw == K_FOR;
+}
+
+/* First pipeline '|' in [p, end): not '||' or the '>|' operator, and
+   outside quotes and $(...). NULL if none. */
+static const char* find_pipe(const char *p, const char *end) {
+    char quote = 0;
+    size_t span;
+    for (const char *start = p; p < end; ++p) {
+        if (quote != '\'' && (span = subst_span(p)) != 0) {
+            p += span - 1;
+        } else if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '|') {
+            if (p + 1 < end && p[1] == '|') ++p;
+            else if (p == start || p[-1] != '>') return p;
+        }
+    }
+    return NULL;
+}
+
+/* The '|' in [s, end) where the next pipeline piece starts: the first
+   one after fi/done (after_block), else the first one followed by a
+   compound keyword. NULL if the pipeline stays in one piece. */
+static const char* piece_end(const char *s, const char *end, int after_block) {
+    for (const char *p = find_pipe(s, end); p != NULL; p = find_pipe(p + 1, end)) {
+        const char *q = p + 1, *rest;
+        while (q != end && (*q == ' ' || *q == '\t')) q++;
+        int kw = keyword_at(q, end, &rest);
+        if (after_block || opens_block(kw) || kw == K_TIME) return p;
+    }
+    return NULL;
+}
+
+/* Scan without modifying text: returns the open-block depth and sets
+   *has_kw if any segment (or pipeline piece) starts with a keyword. */
+static int scan(const char *text, int *has_kw) {
+    int depth = 0;
+    *has_kw = 0;
+    const char *seg = text;
+    while (1) {
+        list_op_t op;
+        const char *end = segment_end(seg, &op);
+        const char *s = seg;
+        while (s != end && (*s == ' ' || *s == '\t')) s++;
+        while (s != end) {
+            const char *rest;
+            int kw = keyword_at(s, end, &rest);
+            if (kw != K_NONE) {
+                *has_kw = 1;
+                if (opens_block(kw)) depth++;
+                if (kw == K_FI || kw == K_DONE) depth--;
+                if (kw == K_FOR) break;
+                s = rest;
+                if (kw != K_FI && kw != K_DONE) continue;
+            }
+            const char *p = piece_end(s, end, kw != K_NONE);
+            if (p == NULL) break;
+            s = p + 1;
+            while (s != end && (*s == ' ' || *s == '\t')) s++;
+        }
+        if (op == LIST_END) break;
+        seg = end + list_op_len(op);
+    }
+    return depth;
+}
+
+int compound_depth(const char *text) {
+    int has_kw;
+    return scan(text, &has_kw);
+}
+
+/* ------------------- parsing ------------------- */
+
+typedef struct {
+    seg_t *segs;
+    int n;
+    int cap;
+    int i;
+    int err;
+} parser_t;
+
+static int push_seg(parser_t *ps, char *text, int kw, int piped) {
+    if (ps->n == ps->cap) {
+        int ncap = ps->cap ? ps->cap * 2 : 32;
+        seg_t *ns = realloc(ps->segs, sizeof(seg_t) * (size_t)ncap);
+        if (ns == NULL) return -1;
+        ps->segs = ns;
+        ps->cap = ncap;
+    }
+    ps->segs[ps->n].text = text;
+    ps->segs[ps->n].kw = kw;
+    ps->segs[ps->n].piped = piped;
+    ps->n++;
+    return 0;
+}
+
+/* Split text in place into segments, peeling leading keywords off
+   ("do echo x" -> do, "echo x") and cutting pipelines where a compound
+   command starts or ends ("cat f | while read l" -> "cat f" piped,
+   while, "read l"; "done > out | sort" -> done "> out" piped, "sort") */
+static int split_segments(parser_t *ps, char *text) {
+    char *seg = text;
+    while (1) {
+        list_op_t op;
+        char *end = segment_end(seg, &op);
+        char *next = end + list_op_len(op);
+        *end = '\0';
+
+        while (*seg == ' ' || *seg == '\t') seg++;
+        char *tail = end;
+        while (tail > seg && (tail[-1] == ' ' || tail[-1] == '\t')) *--tail = '\0';
+
+        while (*seg != '\0') {
+            const char *rest;
+            int kw = keyword_at(seg, tail, &rest);
+            if (kw == K_FOR) {
+                if (push_seg(ps, (char*)rest, kw, 0) != 0) return -1;
+                break;
+            }
+            if (kw != K_NONE && kw != K_FI && kw != K_DONE) {
+                if (push_seg(ps, NULL, kw, 0) != 0) return -1;
+                seg = (char*)rest;
+                continue;
+            }
+            char *text = kw == K_NONE ? seg : (char*)rest;
+            char *p = (char*)piece_end(text, tail, kw != K_NONE);
+            if (p != NULL) {
+                char *t = p;
+                *t = '\0';
+                while (t > text && (t[-1] == ' ' || t[-1] == '\t')) *--t = '\0';
+            }
+            if (push_seg(ps, text, kw, p != NULL) != 0) return -1;
+            if (p == NULL) break;
+            seg = p + 1;
+            while (*seg == ' ' || *seg == '\t') seg++;
+        }
+
+        if (op == LIST_END) break;
+        seg = next;
+    }
+    return 0;
+}
+
+static void free_nodes(node_t *n) {
+    while (n != NULL) {
+        node_t *next = n->next;
+        for (int i = 0; i < n->ncmds; ++i) free_tokens(n->cmds[i]);
+        free(n->cmds);
+        free(n->ops);
+        free_nodes(n->cond);
+        free_nodes(n->body);
+        free_nodes(n->alt);
+        free_tokens(n->words);
+        free_tokens(n->redir_words);
+        free(n);
+        n = next;
+    }
+}
+
+static const char* kw_name(int kw) {
+    static const char *names[] = { "", "if", "then", "elif", "else", "fi",
+                                   "for", "while", "until", "do", "done", "time" };
+    return names[kw];
+}
+
+static void syntax_error(parser_t *ps, const char *msg, int kw) {
+    if (!ps->err)
+        fprintf(stderr, "syntax error: %s '%s'\n", msg, kw_name(kw));
+    ps->err = 1;
+}
+
+static int expect(parser_t *ps, int kw) {
+    if (ps->i < ps->n && ps->segs[ps->i].kw == kw) {
+        ps->i++;
+        return 1;
+    }
+    syntax_error(ps, "missing", kw);
+    return 0;
+}
+
+/* Tokenize a trailing "cmd&" into "cmd" "&" now, so detect_background
+   never has to shorten a token that later runs share. */
+static void split_trailing_amp(tokens_t *t) {
+    if (t->argc == 0) return;
+    char *last = t->argv[t->argc - 1];
+    size_t len = strlen(last);
+    int fd;
+    if (len > 1 && last[len - 1] == '&' && !(t->flags[t->argc - 1] & TOK_QUOTED) &&
+        redir_op(last, &fd) < 0) {
+        last[len - 1] = '\0';
+        tokens_push(t, "&", 0);
+    }
+}
+
+/* One segment: an and-or list of simple commands, tokenized now */
+static node_t* compile_list(char *text) {
+    node_t *n = calloc(1, sizeof(node_t));
+    if (n == NULL) return NULL;
+    n->kind = N_LIST;
+
+    int cap = 0;
+    list_op_t op = LIST_SEQ, next;
+    char *cmd = text;
+    while (1) {
+        char *p = find_list_op(cmd, &next);
+        char *after = p + list_op_len(next);
+        *p = '\0';
+        tokens_t *t = tokenize(cmd);
+        if (t != NULL) {
+            if (n->ncmds == cap) {
+                cap = cap ? cap * 2 : 2;
+                tokens_t **nc = realloc(n->cmds, sizeof(tokens_t*) * (size_t)cap);
+                list_op_t *no = realloc(n->ops, sizeof(list_op_t) * (size_t)cap);
+                if (nc != NULL) n->cmds = nc;
+                if (no != NULL) n->ops = no;
+                if (nc == NULL || no == NULL) {
+                    free_tokens(t);
+                    free_nodes(n);
+                    return NULL;
+                }
+            }
+            split_trailing_amp(t);
+            n->cmds[n->ncmds] = t;
+            n->ops[n->ncmds] = op;
+            n->ncmds++;
+        }
+        if (next == LIST_END) break;
+        op = next;
+        cmd = after;
+    }
+    return n;
+}
+
+static node_t* parse_list(parser_t *ps, unsigned stop);
+
+/* parse_list for a condition or body, which sh does not allow to be
+   empty ("while; do", "then fi"): the keyword that came too early is
+   reported */
+static node_t* parse_body(parser_t *ps, unsigned stop) {
+    node_t *n = parse_list(ps, stop);
+    if (n == NULL && !ps->err && ps->i < ps->n)
+        syntax_error(ps, "unexpected", ps->segs[ps->i].kw);
+    return n;
+}
+
+/* After "if"/"elif": cond; then body; [elif ...|else body]; fi */
+static node_t* parse_if(parser_t *ps) {
+    node_t *n = calloc(1, sizeof(node_t));
+    if (n == NULL) {
+        ps->err = 1;
+        return NULL;
+    }
+    n->kind = N_IF;
+    n->cond = parse_body(ps, KW(K_THEN));
+    if (!expect(ps, K_THEN)) return n;
+    n->body = parse_body(ps, KW(K_ELIF) | KW(K_ELSE) | KW(K_FI));
+    if (ps->err) return n;
+    if (ps->i < ps->n && ps->segs[ps->i].kw == K_ELIF) {
+        ps->i++;
+        n->alt = parse_if(ps);   /* shares this if's fi */
+        return n;
+    }
+    if (ps->i < ps->n && ps->segs[ps->i].kw == K_ELSE) {
+        ps->i++;
+        n->alt = parse_body(ps, KW(K_FI));
+    }
+    expect(ps, K_FI);
+    return n;
+}
+
+static node_t* parse_loop(parser_t *ps, int kw, char *header) {
+    node_t *n = calloc(1, sizeof(node_t));
+    if (n == NULL) {
+        ps->err = 1;
+        return NULL;
+    }
+    if (kw == K_FOR) {
+        n->kind = N_FOR;
+        char *name = header;
+        char *p = name;
+        while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+        if (*p != '\0') *p++ = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+        if (!is_valid_name(name)) {
+            fprintf(stderr, "syntax error: bad for variable '%s'\n", name);
+            ps->err = 1;
+            return n;
+        }
+        n->var = name;
+        if (strncmp(p, "in", 2) == 0 && (p[2] == '\0' || p[2] == ' ' || p[2] == '\t')) {
+            n->words = tokenize(p + 2);
+        } else if (*p != '\0') {
+            fprintf(stderr, "syntax error: expected 'in' after 'for %s'\n", name);
+            ps->err = 1;
+            return n;
+        }
+    } else {
+        n->kind = kw == K_WHILE ? N_WHILE : N_UNTIL;
+        n->cond = parse_body(ps, KW(K_DO));
+    }
+    if (!expect(ps, K_DO)) return n;
+    n->body = parse_body(ps, KW(K_DONE));
+    expect(ps, K_DONE);
+    return n;
+}
+
+/* The text after fi/done: redirections for the whole command, kept
+   unexpanded until it runs */
+static void attach_redirs(parser_t *ps, node_t *n, const seg_t *close) {
+    if (close->text == NULL || *close->text == '\0') return;
+    tokens_t *t = tokenize(close->text);
+    if (t == NULL) return;
+    for (int i = 0; i < t->argc; i += 2) {
+        int fd;
+        if (redir_op(t->argv[i], &fd) < 0 || (t->flags[i] & TOK_QUOTED)) {
+            fprintf(stderr, "syntax error: unexpected '%s' after '%s'\n", t->argv[i], kw_name(close->kw));
+            ps->err = 1;
+        } else if (i + 1 == t->argc) {
+            fprintf(stderr, "syntax error: expected word after '%s'\n", t->argv[i]);
+            ps->err = 1;
+        }
+        if (ps->err) {
+            free_tokens(t);
+            return;
+        }
+    }
+    n->redir_words = t;
+}
+
+/* N_TIME around n */
+static node_t* wrap_time(parser_t *ps, node_t *n) {
+    if (n == NULL) return NULL;
+    node_t *t = calloc(1, sizeof(node_t));
+    if (t == NULL) {
+        ps->err = 1;
+        free_nodes(n);
+        return NULL;
+    }
+    t->kind = N_TIME;
+    t->body = n;
+    return t;
+}
+
+/* One command at ps->i: a simple list or a whole compound command.
+   *piped is set if a '|' follows it. */
+static node_t* parse_command(parser_t *ps, int *piped) {
+    seg_t *sg = &ps->segs[ps->i++];
+    node_t *n;
+    *piped = 0;
+    switch (sg->kw) {
+    case K_NONE:
+        n = compile_list(sg->text);
+        if (n == NULL) ps->err = 1;
+        *piped = sg->piped;
+        return n;
+    case K_IF:
+        n = parse_if(ps);
+        break;
+    case K_FOR:
+        n = parse_loop(ps, K_FOR, sg->text);
+        break;
+    case K_WHILE:
+    case K_UNTIL:
+        n = parse_loop(ps, sg->kw, NULL);
+        break;
+    case K_TIME:   /* a pipeline piece: times just that piece */
+        return wrap_time(ps, parse_command(ps, piped));
+    default:
+        syntax_error(ps, "unexpected", sg->kw);
+        return NULL;
+    }
+    if (n != NULL && !ps->err) {
+        const seg_t *close = &ps->segs[ps->i - 1];   /* its fi or done */
+        attach_redirs(ps, n, close);
+        *piped = close->piped;
+    }
+    return n;
+}
+
+/* first | ... : the pieces of a pipeline, the first one already parsed */
+static node_t* parse_pipe(parser_t *ps, node_t *first) {
+    node_t *n = calloc(1, sizeof(node_t));
+    if (n == NULL) {
+        ps->err = 1;
+        free_nodes(first);
+        return NULL;
+    }
+    n->kind = N_PIPE;
+    n->body = first;
+    node_t *piece = first, **tail = &first->next;
+    int piped = 1;
+    while (piped && !ps->err) {
+        if (piece->kind == N_LIST && piece->ncmds != 1) {
+            fprintf(stderr, piece->ncmds == 0 ? "syntax error: unexpected '|'\n"
+                                              : "syntax error: '&&'/'||' list before '|'\n");
+            ps->err = 1;
+            break;
+        }
+        if (ps->i == ps->n) {
+            fprintf(stderr, "syntax error: missing command after '|'\n");
+            ps->err = 1;
+            break;
+        }
+        piece = parse_command(ps, &piped);
+        if (piece == NULL) break;
+        *tail = piece;
+        tail = &piece->next;
+    }
+    return n;
+}
+
+/* Parse segments until one whose keyword is in stop (not consumed) */
+static node_t* parse_list(parser_t *ps, unsigned stop) {
+    node_t *head = NULL, **tail = &head;
+    while (ps->i < ps->n && !ps->err) {
+        if (KW(ps->segs[ps->i].kw) & stop) break;
+        int piped;
+        int timed = ps->segs[ps->i].kw == K_TIME;   /* the whole pipeline */
+        if (timed) ps->i++;
+        node_t *n = parse_command(ps, &piped);
+        if (n != NULL && piped) n = parse_pipe(ps, n);
+        if (timed) n = wrap_time(ps, n);
+        if (n != NULL) {
+            *tail = n;
+            tail = &n->next;
+        }
+    }
+    return head;
+}
+
+/* ------------------- execution ------------------- */
+
+static int loop_depth = 0;
+static int pending_break = 0;      /* loops still to leave */
+static int pending_continue = 0;   /* then continue the next enclosing one */
+
+/* break/continue builtins: levels counts enclosing loops (>= 1) */
+int loop_control(int is_continue, int levels) {
+    if (loop_depth == 0) return -1;
+    if (levels > loop_depth) levels = loop_depth;
+    pending_break = is_continue ? levels - 1 : levels;
+    pending_continue = is_continue;
+    return 0;
+}
+
+static int run_nodes(node_t *n);
+
+static int run_simple(tokens_t *t) {
+    tokens_t *v = tokens_share(t);
+    if (v == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    int status = execute_tokens(v);
+    free_tokens(v);
+    return status;
+}
+
+/* After a loop body: 1 if the loop must stop (break, or continue aimed
+   further out), 0 to go on with the next iteration */
+static int loop_unwind(void) {
+    if (pending_break > 0) {
+        pending_break--;
+        return 1;
+    }
+    pending_continue = 0;
+    return 0;
+}
+
+static int run_loop(node_t *n) {
+    int status = 0;
+    loop_depth++;
+    if (n->kind == N_FOR) {
+        tokens_t *words = n->words ? tokens_share(n->words) : NULL;
+        if (words != NULL) expand_tokens(words);
+        for (int i = 0; words != NULL && i < words->argc; ++i) {
+            set_var(n->var, words->argv[i]);
+            status = run_nodes(n->body);
+            if (loop_unwind()) break;
+        }
+        free_tokens(words);
+    } else {
+        while (1) {
+            int c = run_nodes(n->cond);
+            if (pending_break || pending_continue) {
+                if (loop_unwind()) break;
+                continue;
+            }
+            if ((c == 0) != (n->kind == N_WHILE)) break;
+            status = run_nodes(n->body);
+            if (loop_unwind()) break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+static int run_node(node_t *n, int status);
+static int run_plain(node_t *n, int status);
+
+/* Every piece of an N_PIPE in a forked child, stdout to the next one's
+   stdin; the status is that of the last piece. */
+static int run_pipe(node_t *n) {
+    int npieces = 0;
+    for (node_t *p = n->body; p != NULL; p = p->next) npieces++;
+    pid_t *pids = calloc((size_t)npieces, sizeof(pid_t));
+    if (pids == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    int started = 0, prev_read = -1;
+    for (node_t *p = n->body; p != NULL; p = p->next) {
+        int pipefd[2] = { -1, -1 };
+        if (p->next != NULL && pipe2(pipefd, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            break;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            child_reset_signals();
+            if (prev_read != -1) {
+                dup2(prev_read, STDIN_FILENO);
+                close(prev_read);
+            }
+            if (pipefd[1] != -1) {
+                dup2(pipefd[1], STDOUT_FILENO);
+                close(pipefd[1]);
+                close(pipefd[0]);
+            }
+            loop_depth = 0;   /* break/continue stay inside the piece */
+            execute_set_piped_output(p->next != NULL && p->kind == N_LIST);
+            int rc = run_node(p, 0);
+            fflush(stdout);
+            _exit(rc & 0xff);
+        }
+        if (pid < 0) perror("fork");
+        if (prev_read != -1) close(prev_read);
+        if (pipefd[1] != -1) close(pipefd[1]);
+        prev_read = pipefd[0];
+        if (pid < 0) break;
+        pids[started++] = pid;
+    }
+    if (prev_read != -1) close(prev_read);
+
+    int status = 0;
+    for (int i = 0; i < started; ++i) {
+        int ws;
+        struct rusage ru;
+        if (wait4(pids[i], &ws, 0, &ru) == pids[i]) {
+            execute_note_usage(&ru);
+            status = WIFEXITED(ws) ? WEXITSTATUS(ws) : 128 + WTERMSIG(ws);
+        }
+    }
+    free(pids);
+    return started < npieces ? 127 : status;
+}
+
+/* Run a compound command with the redirections after its fi/done
+   applied, and undo them after */
+static int run_redirected(node_t *n, int status) {
+    tokens_t *w = tokens_share(n->redir_words);
+    redir_t *r = w ? malloc(sizeof(redir_t) * (size_t)(w->argc + 1)) : NULL;
+    redir_saved_t *saved = w ? malloc(sizeof(redir_saved_t) * (size_t)(w->argc + 1)) : NULL;
+    if (w == NULL || r == NULL || saved == NULL) {
+        perror("malloc");
+        free(saved);
+        free(r);
+        free_tokens(w);
+        return 1;
+    }
+    expand_tokens(w);
+
+    int nr = 0, nsaved = 0, ok = 1;
+    for (int i = 0; ok && i < w->argc; i += 2) {
+        int k = i + 1 < w->argc ? redir_parse(w->argv[i], w->argv[i + 1], r + nr) : -1;
+        if (k < 0) ok = 0;
+        else nr += k;
+    }
+    fflush(stdout);
+    if (ok && redir_apply(r, nr, saved, &nsaved) == 0) {
+        status = run_plain(n, status);
+        fflush(stdout);
+        fflush(stderr);
+    } else {
+        status = 1;
+    }
+    redir_restore(saved, nsaved);
+
+    free(saved);
+    free(r);
+    free_tokens(w);
+    return status;
+}
+
+static int run_timed_body(void *body) {
+    return run_node(body, get_last_status());
+}
+
+/* Run one node (not its successors), given the status so far */
+static int run_node(node_t *n, int status) {
+    if (n->redir_words != NULL) return run_redirected(n, status);
+    return run_plain(n, status);
+}
+
+/* run_node without the node's own redirections */
+static int run_plain(node_t *n, int status) {
+    switch (n->kind) {
+    case N_LIST:
+        for (int i = 0; i < n->ncmds && !pending_break && !pending_continue; ++i) {
+            list_op_t op = n->ops[i];
+            if (op == LIST_SEQ || (op == LIST_AND && status == 0) || (op == LIST_OR && status != 0))
+                status = run_simple(n->cmds[i]);
+        }
+        return status;
+    case N_IF:
+        if (run_nodes(n->cond) == 0)
+            return n->body ? run_nodes(n->body) : 0;
+        return n->alt ? run_nodes(n->alt) : 0;
+    case N_PIPE:
+        return run_pipe(n);
+    case N_TIME:
+        return run_timed(run_timed_body, n->body);
+    default:
+        return run_loop(n);
+    }
+}
+
+static int run_nodes(node_t *n) {
+    int status = get_last_status();
+    for (; n != NULL && !pending_break && !pending_continue; n = n->next) {
+        status = run_node(n, status);
+        set_last_status(status);
+    }
+    return status;
+}
+
+int run_compound(char *text) {
+    int has_kw;
+    scan(text, &has_kw);
+    if (!has_kw) return 0;
+
+    parser_t ps = { NULL, 0, 0, 0, 0 };
+    node_t *tree = NULL;
+    if (split_segments(&ps, text) != 0) {
+        perror("malloc");
+        ps.err = 1;
+    } else {
+        tree = parse_list(&ps, 0);
+    }
+
+    if (ps.err)
+        set_last_status(2);
+    else
+        run_nodes(tree);
+
+    free_nodes(tree);
+    free(ps.segs);
+    return 1;
+}
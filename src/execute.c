@@ -1,17 +1,22 @@
 /* src/execute.c
  * Support:
- *  - Input redirection:  cmd < infile
- *  - Output redirection: cmd > outfile
- *  - Single pipe:        cmd1 | cmd2
+ *  - Redirections:       <, >, >>, <>, n>, n>>, n>&m, n<&m, n>&-, &>, &>> (redir.c)
+ *  - Here-documents:     cmd <<EOF ... EOF, and here-strings: cmd <<< word
+ *  - Pipelines:          cmd1 | cmd2 | ... | cmdN (pipe capacity: pipesize)
+ *  - Redirect-only stage: "< file | cmd" feeds file to cmd via splice
  *  - Command chaining:   cmd1 ; cmd2 ; cmd3
  *  - Background execution via &
+ *  - Command substitution: $(cmd) and `cmd`
  *
  * Updated to use add_job() returning job index (1-based) and to print correct job numbers.
  */
 
+#define _GNU_SOURCE  /* pipe2, memfd_create */
 #include "shell.h"
 #include <fcntl.h>  // open flags
 #include <sys/stat.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include <ctype.h>   // for isspace()
 #include <string.h>
 #include <stdlib.h>
@@ -19,37 +24,159 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <spawn.h>
+#include <signal.h>
 
-static void parse_side(char *tokens[], char *argv[], char **in_file, char **out_file) {
+/* Process launch backend. posix_spawn avoids copying the shell's page
+   tables (glibc implements it with clone(CLONE_VM|CLONE_VFORK)), so launch
+   cost no longer grows with the shell's RSS. fork is kept selectable for
+   comparison and for stages that must run shell code in the child. */
+static spawn_backend_t spawn_backend = SPAWN_POSIX;
+
+int set_spawn_backend(const char *name) {
+    if (name == NULL) return -1;
+    if (strcmp(name, "fork") == 0) {
+        spawn_backend = SPAWN_FORK;
+    } else if (strcmp(name, "posix_spawn") == 0 || strcmp(name, "posix") == 0) {
+        spawn_backend = SPAWN_POSIX;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char* get_spawn_backend(void) {
+    return spawn_backend == SPAWN_FORK ? "fork" : "posix_spawn";
+}
+
+/* Pipe capacity for pipelines, 0 to keep the kernel default. A bulk
+   pipeline with the default 64 KiB pipe switches between writer and
+   reader every 16 pages; a 1 MiB pipe lets each side run for longer. */
+static long pipe_size = 0;
+
+/* /proc/sys/fs/pipe-max-size, read once (1 MiB, the kernel's default, if
+   it cannot be read) */
+static long pipe_max_size(void) {
+    static long max = 0;
+    if (max == 0) {
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (f == NULL || fscanf(f, "%ld", &max) != 1 || max <= 0) max = 1L << 20;
+        if (f != NULL) fclose(f);
+    }
+    return max;
+}
+
+int set_pipe_size(const char *spec) {
+    if (spec == NULL) return -1;
+    if (strcmp(spec, "default") == 0) {
+        pipe_size = 0;
+        return 0;
+    }
+    if (strcmp(spec, "max") == 0) {
+        pipe_size = pipe_max_size();
+        return 0;
+    }
+    char *end;
+    long n = strtol(spec, &end, 10);
+    if (end == spec || n <= 0) return -1;
+    if (*end == 'k' || *end == 'K') {
+        n = n > LONG_MAX / 1024 ? LONG_MAX : n * 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        n = n > LONG_MAX / (1024 * 1024) ? LONG_MAX : n * 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0') return -1;
+    pipe_size = n < pipe_max_size() ? n : pipe_max_size();
+    return 0;
+}
+
+long get_pipe_size(void) {
+    return pipe_size;
+}
+
+/* Resize a new pipe. Failure is not an error: an unprivileged user past
+   fs.pipe-user-pages-soft gets EPERM and keeps the default size. */
+static void size_pipe(int fd) {
+    if (pipe_size > 0) fcntl(fd, F_SETPIPE_SZ, (int)pipe_size);
+}
+
+/* One stage of a pipeline: its argv plus the redirections from parse_side */
+typedef struct {
+    char **argv;
+    redir_t *redirs;    /* fd operations in source order (redir.c) */
+    int nredirs;
+    const char *path;   /* resolved via the hash cache, NULL => execvp */
+    builtin_fn builtin; /* non-NULL => run the builtin instead of exec */
+} stage_t;
+
+/* Split a stage's tokens into st->argv (caller-provided, room for every
+   token) and its redirections, appended to st->redirs (room for every
+   token) in order. Returns 0, or -1 after reporting a syntax error. */
+static int parse_side(char *tokens[], stage_t *st) {
+    char **argv = st->argv;
     int ai = 0;
-    *in_file = NULL;
-    *out_file = NULL;
+    st->nredirs = 0;
 
     for (int i = 0; tokens[i] != NULL; ++i) {
-        if (strcmp(tokens[i], "<") == 0) {
-            if (tokens[i+1] == NULL) {
-                fprintf(stderr, "syntax error: expected filename after '<'\n");
-                argv[0] = NULL;
-                return;
-            }
-            *in_file = tokens[i+1];
-            ++i;
-        } else if (strcmp(tokens[i], ">") == 0) {
-            if (tokens[i+1] == NULL) {
-                fprintf(stderr, "syntax error: expected filename after '>'\n");
-                argv[0] = NULL;
-                return;
-            }
-            *out_file = tokens[i+1];
-            ++i;
-        } else {
-            if (ai < MAXARGS + 1) {
-                argv[ai++] = tokens[i];
-            }
+        int fd;
+        int op = redir_op(tokens[i], &fd);
+        if (op < 0) {
+            argv[ai++] = tokens[i];
+            continue;
+        }
+        if (tokens[i+1] == NULL) {
+            fprintf(stderr, "syntax error: expected %s after '%s'\n",
+                    op == REDIR_HEREDOC ? "delimiter" : op == REDIR_HERESTR ? "word" :
+                    op == REDIR_DUP_IN || op == REDIR_DUP_OUT ? "fd" : "filename", tokens[i]);
+            argv[0] = NULL;
+            return -1;
+        }
+        int n = redir_parse(tokens[i], tokens[i+1], st->redirs + st->nredirs);
+        if (n < 0) {
+            argv[0] = NULL;
+            return -1;
         }
+        st->nredirs += n;
+        ++i;
     }
     argv[ai] = NULL;
-    if (ai == 0) argv[0] = NULL;
+    return 0;
+}
+
+/* A stage of redirections alone runs one of these in place of a command.
+   Feeding a pipe with stdin redirected, it copies stdin to stdout, as zsh
+   does: "< f | cmd" feeds f to cmd through splice, no cat, no user-space
+   copy. Anywhere else it only performs the opens, as in sh: "< f" alone
+   opens f, "> f" creates or truncates it. */
+static int redirect_copy(char **argv) {
+    (void)argv;
+    return redir_pump(STDIN_FILENO, STDOUT_FILENO) == 0 ? 0 : 1;
+}
+
+static int redirect_only(char **argv) {
+    (void)argv;
+    return 0;
+}
+
+/* Set in a forked piece of a compound pipeline ("< f | while ...") that is
+   a plain pipeline feeding the next piece: its last stage feeds a pipe */
+static int piped_output = 0;
+
+void execute_set_piped_output(int on) {
+    piped_output = on;
+}
+
+static builtin_fn redirect_stage(const stage_t *st, int feeds_pipe) {
+    if (!feeds_pipe) return redirect_only;
+    for (int i = 0; i < st->nredirs; ++i) {
+        const redir_t *r = &st->redirs[i];
+        if (r->fd == STDIN_FILENO && r->kind != RD_CLOSE &&
+            !(r->kind == RD_OPEN && (r->oflags & O_ACCMODE) == O_WRONLY))
+            return redirect_copy;
+    }
+    return redirect_only;
 }
 
 /* Helper to join tokens into a single command string for job entries */
@@ -78,9 +205,11 @@ static int detect_background(char *arglist[]) {
         return 1;
     }
 
-    /* Case 2: last token ends with '&' (e.g., "sleep&") */
+    /* Case 2: last token ends with '&' (e.g., "sleep&"), unless it is a
+       redirection operator ("2>&" still needs its fd) */
     size_t len = strlen(arglist[i-1]);
-    if (len > 0 && arglist[i-1][len - 1] == '&') {
+    int fd;
+    if (len > 0 && arglist[i-1][len - 1] == '&' && redir_op(arglist[i-1], &fd) < 0) {
         /* remove trailing '&' */
         if (len == 1) { /* token was just "&" but handled above; safe check */
             arglist[i-1] = NULL;
@@ -93,271 +222,1153 @@ static int detect_background(char *arglist[]) {
     return 0;
 }
 
-int execute_single(char* arglist[]) {
-    if (arglist == NULL || arglist[0] == NULL) return 0;
-
-    /* detect background for this arglist (will modify arglist) */
-    int background = detect_background(arglist);
+/* First thing in every forked child: the shell blocks SIGCHLD for its
+   signalfd (and SIGPIPE while pumping), children start with none blocked */
+void child_reset_signals(void) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
 
-    // Count pipes and locate pipe position (if any)
-    int pipe_count = 0;
-    int pipe_pos = -1;
-    for (int i = 0; arglist[i] != NULL; ++i) {
-        if (strcmp(arglist[i], "|") == 0) {
-            pipe_count++;
-            if (pipe_pos == -1) pipe_pos = i;
+/* fork backend: child wires in_fd/out_fd onto stdin/stdout, applies the
+   stage's own redirections (after the pipes, so '<' or '>' overrides a
+   pipe end), then execs (or runs the stage's builtin and
+   exits with its status). Pipe fds are O_CLOEXEC, so any other pipe ends
+   still open in the shell vanish at exec. A builtin never execs, so the
+   one other end open at this point, the read end of the stage's own
+   output pipe (spare_fd), is closed by hand: kept, the pipe would never
+   lose its last reader. */
+static pid_t launch_fork(const stage_t *st, int in_fd, int out_fd, int spare_fd, char **envp) {
+    fflush(stdout);   /* don't let the child inherit (and repeat) buffered output */
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        if (spare_fd != -1) close(spare_fd);
+        if (in_fd != -1) {
+            if (dup2(in_fd, STDIN_FILENO) < 0) {
+                perror("dup2 pipe read");
+                _exit(1);
+            }
+            close(in_fd);
         }
+        if (out_fd != -1) {
+            if (dup2(out_fd, STDOUT_FILENO) < 0) {
+                perror("dup2 pipe write");
+                _exit(1);
+            }
+            close(out_fd);
+        }
+        if (redir_apply(st->redirs, st->nredirs, NULL, NULL) != 0) _exit(1);
+        child_reset_signals();
+        if (st->builtin != NULL) {
+            int rc = st->builtin(st->argv);
+            fflush(stdout);
+            _exit(rc);
+        }
+        environ = envp;
+        if (st->path != NULL)
+            execve(st->path, st->argv, envp);   /* stale entry falls through to a PATH walk */
+        execvp(st->argv[0], st->argv);
+        perror(st->argv[0]);
+        _exit(127);   /* the status posix_spawn failures get */
     }
+    return pid;
+}
 
-    if (pipe_count > 1) {
-        fprintf(stderr, "error: multiple pipes not supported (this shell supports a single '|').\n");
+/* posix_spawn backend: the same wiring as launch_fork, expressed as file
+   actions so no page tables are copied: the pipe ends first, then the
+   stage's redirection list (files are opened here in the parent so open
+   errors are reported precisely). All source fds are O_CLOEXEC (pipes
+   come from pipe2), and dup2 clears the flag on the target, so only the
+   redirected fds survive the exec. */
+static pid_t launch_spawn(const stage_t *st, int in_fd, int out_fd, char **envp) {
+    pid_t pid = -1;
+    int opened_buf[8];
+    int *opened = st->nredirs <= 8 ? opened_buf : malloc(sizeof(int) * (size_t)st->nredirs);
+    int nopened = 0;
+    if (opened == NULL) {
+        perror("malloc");
         return -1;
     }
 
-    if (pipe_count == 0) {
-        char *argv[MAXARGS + 2];
-        char *in_file = NULL;
-        char *out_file = NULL;
-        parse_side(arglist, argv, &in_file, &out_file);
-        if (argv[0] == NULL) {
-            fprintf(stderr, "syntax error: no command to execute\n");
-            return -1;
+    posix_spawn_file_actions_t fa;
+    int rc = posix_spawn_file_actions_init(&fa);
+    if (rc != 0) {
+        fprintf(stderr, "posix_spawn_file_actions_init: %s\n", strerror(rc));
+        goto out;
+    }
+    if (in_fd != -1)
+        posix_spawn_file_actions_adddup2(&fa, in_fd, STDIN_FILENO);
+    if (out_fd != -1)
+        posix_spawn_file_actions_adddup2(&fa, out_fd, STDOUT_FILENO);
+    if (st->nredirs > 0) {
+        uint64_t t0 = trace_start();
+        nopened = redir_spawn_actions(st->redirs, st->nredirs, &fa, opened);
+        trace_stop(TR_REDIRECT, t0);
+        if (nopened < 0) {
+            nopened = 0;
+            posix_spawn_file_actions_destroy(&fa);
+            goto out;
         }
+    }
 
-        pid_t cpid = fork();
-        if (cpid < 0) {
-            perror("fork failed");
-            return -1;
-        }
+    /* child_reset_signals, done by posix_spawn itself */
+    posix_spawnattr_t attr;
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
 
-        if (cpid == 0) {
-            /* Child: set up redirections, then exec */
-            if (in_file != NULL) {
-                int fdin = open(in_file, O_RDONLY);
-                if (fdin < 0) {
-                    perror("open input file");
-                    _exit(1);
-                }
-                if (dup2(fdin, STDIN_FILENO) < 0) {
-                    perror("dup2 input");
-                    close(fdin);
-                    _exit(1);
-                }
-                close(fdin);
-            }
-            if (out_file != NULL) {
-                int fdout = open(out_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fdout < 0) {
-                    perror("open output file");
-                    _exit(1);
-                }
-                if (dup2(fdout, STDOUT_FILENO) < 0) {
-                    perror("dup2 output");
-                    close(fdout);
-                    _exit(1);
-                }
-                close(fdout);
-            }
-            execvp(argv[0], argv);
-            perror("execvp");
-            _exit(1);
-        } else {
-            if (background) {
-                /* Parent: don't wait; add to jobs */
-                char cmd[JOB_CMD_LEN];
-                join_tokens(arglist, cmd, sizeof(cmd));
-                int jid = add_job(cpid, cmd);
-                if (jid >= 0)
-                    printf("[%d] %d\n", jid, (int)cpid); /* print correct background job notification */
-                else
-                    printf("[?] %d\n", (int)cpid);
-                return 0;
-            } else {
-                int status;
-                waitpid(cpid, &status, 0);
-                return 0;
-            }
+    if (st->path != NULL) {
+        rc = posix_spawn(&pid, st->path, &fa, &attr, st->argv, envp);
+        if (rc == ENOENT) {
+            /* cached binary vanished: forget it and walk PATH again */
+            path_cache_forget(st->argv[0]);
+            rc = posix_spawnp(&pid, st->argv[0], &fa, &attr, st->argv, envp);
         }
     } else {
-        /*********************
-         * Single-pipe case  *
-         *********************/
-        char *left_tokens[MAXARGS + 2];
-        char *right_tokens[MAXARGS + 2];
-        int li = 0, ri = 0;
-        for (int i = 0; arglist[i] != NULL; ++i) {
-            if (i < pipe_pos) {
-                left_tokens[li++] = arglist[i];
-            } else if (i > pipe_pos) {
-                right_tokens[ri++] = arglist[i];
+        rc = posix_spawnp(&pid, st->argv[0], &fa, &attr, st->argv, envp);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", st->argv[0], strerror(rc));
+        pid = -1;
+    }
+
+out:
+    while (nopened > 0) close(opened[--nopened]);
+    if (opened != opened_buf) free(opened);
+    return pid;
+}
+
+/* Builtin stages need shell code in the child, so they always fork */
+static pid_t launch_stage(const stage_t *st, int in_fd, int out_fd, int spare_fd, char **envp) {
+    if (spawn_backend == SPAWN_POSIX && st->builtin == NULL)
+        return launch_spawn(st, in_fd, out_fd, envp);
+    return launch_fork(st, in_fd, out_fd, spare_fd, envp);
+}
+
+/* A parsed command line: its stages plus the backing token storage */
+typedef struct {
+    stage_t *stages;
+    int nstages;
+    int background;
+    char **tokbuf;
+    redir_t *redirs;
+} pipeline_t;
+
+/* Start every stage of the pipeline, wiring stage i's stdout to stage i+1's
+   stdin. All stages are started before any wait, so they run concurrently.
+   A stage that cannot be started is reported and skipped, as in sh: its
+   reader sees EOF and the rest still run ("nonexistent | cat"). pids must
+   have room for nstages entries and gets the pids started, in order.
+   Returns how many were started; *failed is set if the last stage (whose
+   status would be the pipeline's) was not, or if the pipes could not
+   all be created. first_in and
+   final_out, if not -1, become the first stage's stdin and the last
+   stage's stdout (the caller closes them). */
+static int start_pipeline(pipeline_t *pl, pid_t *pids, int *failed, int first_in, int final_out) {
+    stage_t *stages = pl->stages;
+    int nstages = pl->nstages;
+
+    /* exported variables, rebuilt only if an export changed */
+    char **envp = get_exported_env();
+    if (envp == NULL) envp = environ;
+
+    int started = 0;
+    int prev_read = first_in;   /* read end of the pipe feeding the current stage */
+    *failed = 0;
+
+    for (int s = 0; s < nstages; ++s) {
+        int pipefd[2] = { -1, -1 };
+        if (s < nstages - 1) {
+            if (pipe2(pipefd, O_CLOEXEC) < 0) {
+                perror("pipe2");
+                *failed = 1;
+                break;
             }
+            size_pipe(pipefd[1]);
         }
-        left_tokens[li] = NULL;
-        right_tokens[ri] = NULL;
-
-        /* For pipes, background semantics apply to the whole pipeline.
-           Decide background by checking right_tokens and left_tokens for & as well.
-        */
-        int pipeline_background = background;
-        if (!pipeline_background) {
-            /* If background not already detected, check right side too */
-            if (detect_background(right_tokens)) pipeline_background = 1;
-            else if (detect_background(left_tokens)) pipeline_background = 1;
+
+        uint64_t t0 = trace_start();
+        stages[s].path = stages[s].builtin ? NULL : path_cache_lookup(stages[s].argv[0]);
+        trace_stop(TR_PATH, t0);
+        int out = s < nstages - 1 ? pipefd[1] : final_out;
+        t0 = trace_start();
+        pid_t pid = launch_stage(&stages[s], prev_read, out, pipefd[0], envp);
+        trace_stop(TR_SPAWN, t0);
+
+        /* Parent: drop the ends that now belong to the children */
+        if (prev_read != -1 && prev_read != first_in) close(prev_read);
+        if (pipefd[1] != -1) close(pipefd[1]);
+        prev_read = pipefd[0];
+        if (pid < 0) {
+            if (s == nstages - 1) *failed = 1;
+            continue;
         }
+        pids[started++] = pid;
+    }
+    if (prev_read != -1 && prev_read != first_in) close(prev_read);
+    return started;
+}
 
-        char *left_argv[MAXARGS + 2];
-        char *right_argv[MAXARGS + 2];
-        char *left_in = NULL, *left_out = NULL;
-        char *right_in = NULL, *right_out = NULL;
+/* Resource usage of foreground children reaped since execute_timed
+   last cleared it */
+static struct rusage fg_usage;
+static int fg_reaped = 0;
 
-        parse_side(left_tokens, left_argv, &left_in, &left_out);
-        parse_side(right_tokens, right_argv, &right_in, &right_out);
+/* A foreground child was reaped with this usage (wait4) */
+void execute_note_usage(const struct rusage *ru) {
+    rusage_add(&fg_usage, ru);
+    fg_reaped++;
+}
 
-        if (left_argv[0] == NULL || right_argv[0] == NULL) {
-            fprintf(stderr, "syntax error: invalid command on either side of '|'\n");
-            return -1;
+/* Wait for every started stage; the pipeline's status is that of its last
+   stage (128+signal if killed). Each stage's rusage goes into fg_usage. */
+static int wait_pipeline(const pid_t *pids, int started) {
+    int status = 0;
+    uint64_t t0 = trace_start();
+    for (int s = 0; s < started; ++s) {
+        struct rusage ru;
+        if (wait4(pids[s], &status, 0, &ru) == pids[s])
+            execute_note_usage(&ru);
+    }
+    trace_stop(TR_WAIT, t0);
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 0;
+}
+
+/* "< file | cmd" in the foreground: cmd is started on a pipe and the
+   shell itself pumps the file into it, so no process is forked for the
+   copy. SIGPIPE is held off while pumping: a consumer that exits early
+   ends the copy (EPIPE) instead of the shell. Returns cmd's status. */
+static int run_pumped(pipeline_t *pl) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        return 1;
+    }
+    size_pipe(p[1]);
+
+    pipeline_t consumer = *pl;
+    consumer.stages = pl->stages + 1;
+    consumer.nstages = 1;
+    pid_t pid;
+    int failed;
+    int started = start_pipeline(&consumer, &pid, &failed, p[0], -1);
+    close(p[0]);
+
+    /* the stage's own redirections after its stdout goes to the pipe */
+    const stage_t *st = &pl->stages[0];
+    redir_t *r = malloc(sizeof(redir_t) * (size_t)(st->nredirs + 1));
+    redir_saved_t *saved = malloc(sizeof(redir_saved_t) * (size_t)(st->nredirs + 1));
+    int nsaved = 0;
+    if (started == 1 && r != NULL && saved != NULL) {
+        r[0].kind = RD_DUP;
+        r[0].fd = STDOUT_FILENO;
+        r[0].src = p[1];
+        r[0].text = NULL;
+        memcpy(r + 1, st->redirs, sizeof(redir_t) * (size_t)st->nredirs);
+
+        sigset_t pipe_set, old;
+        sigemptyset(&pipe_set);
+        sigaddset(&pipe_set, SIGPIPE);
+        sigprocmask(SIG_BLOCK, &pipe_set, &old);
+        fflush(stdout);
+        uint64_t t0 = trace_start();
+        if (redir_apply(r, st->nredirs + 1, saved, &nsaved) == 0)
+            redir_pump(STDIN_FILENO, STDOUT_FILENO);
+        redir_restore(saved, nsaved);
+        trace_stop(TR_BUILTIN, t0);
+        struct timespec none = { 0, 0 };
+        while (sigtimedwait(&pipe_set, NULL, &none) > 0)
+            ;   /* drop the SIGPIPE an early exit raised */
+        sigprocmask(SIG_SETMASK, &old, NULL);
+    } else if (started == 1) {
+        perror("malloc");
+    }
+    close(p[1]);
+    free(saved);
+    free(r);
+
+    int status = wait_pipeline(&pid, started);
+    return failed ? 127 : status;
+}
+
+/* Run the pipeline in the foreground, or register it as a background job.
+   Returns the last stage's exit status, 0 for a background pipeline, or
+   127 if the pipeline could not be started. */
+static int run_pipeline(pipeline_t *pl, char *arglist[]) {
+    if (pl->nstages == 2 && !pl->background && pl->stages[0].builtin == redirect_copy)
+        return run_pumped(pl);
+
+    pid_t *pids = calloc((size_t)pl->nstages, sizeof(pid_t));
+    if (pids == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    int failed;
+    int started = start_pipeline(pl, pids, &failed, -1, -1);
+
+    if (pl->background && failed) {
+        /* never block on '&': the stages that did start are left to
+           reap_zombies, untracked (the launch already reported why) */
+        free(pids);
+        return 127;
+    }
+    if (pl->background) {
+        /* A background pipeline is one job tracking every stage's pid */
+        pid_t last = pids[started - 1];
+        char cmd[JOB_CMD_LEN];
+        join_tokens(arglist, cmd, sizeof(cmd));
+        int jid = add_job(pids, started, cmd);
+        if (jid >= 0)
+            printf("[%d] %d\n", jid, (int)last);
+        else
+            printf("[?] %d\n", (int)last);
+        free(pids);
+        return 0;
+    }
+
+    int status = wait_pipeline(pids, started);
+    free(pids);
+    return failed ? 127 : status;
+}
+
+/* Run a builtin in the shell itself: the stage's redirections are applied
+   with every affected fd saved first, and undone after. */
+static int run_builtin_inline(const stage_t *st) {
+    redir_saved_t saved_buf[8];
+    redir_saved_t *saved = saved_buf;
+    int nsaved = 0;
+    int status;
+
+    fflush(stdout);
+    if (st->nredirs > 0) {
+        if (st->nredirs > 8 && (saved = malloc(sizeof(*saved) * (size_t)st->nredirs)) == NULL) {
+            perror("malloc");
+            return 1;
         }
+        uint64_t t0 = trace_start();
+        int rc = redir_apply(st->redirs, st->nredirs, saved, &nsaved);
+        trace_stop(TR_REDIRECT, t0);
+        if (rc != 0) {
+            redir_restore(saved, nsaved);
+            if (saved != saved_buf) free(saved);
+            return 1;
+        }
+    }
 
-        int pipefd[2];
-        if (pipe(pipefd) < 0) {
-            perror("pipe");
+    uint64_t t0 = trace_start();
+    status = st->builtin(st->argv);
+    fflush(stdout);
+    fflush(stderr);
+    trace_stop(TR_BUILTIN, t0);
+
+    redir_restore(saved, nsaved);
+    if (saved != saved_buf) free(saved);
+    return status;
+}
+
+static void free_pipeline(pipeline_t *pl) {
+    free(pl->tokbuf);
+    free(pl->redirs);
+    free(pl->stages);
+}
+
+/* Split arglist on '|' into stages, handling '&' and each stage's '<'/'>'.
+   Returns 0 on success, -1 on a syntax or allocation error. */
+static int parse_pipeline(char *arglist[], pipeline_t *pl) {
+    /* detect background for this arglist (will modify arglist) */
+    pl->background = detect_background(arglist);
+
+    /* Count tokens and stages ('|' separates stages) */
+    int ntokens = 0;
+    int nstages = 1;
+    for (int i = 0; arglist[i] != NULL; ++i) {
+        ntokens++;
+        if (strcmp(arglist[i], "|") == 0) nstages++;
+    }
+
+    /* One backing array holds every stage's tokens and argv, each
+       NULL-terminated, and another every stage's redirections (an
+       operator and its target give at most two operations). */
+    pl->nstages = nstages;
+    pl->stages = calloc((size_t)nstages, sizeof(stage_t));
+    pl->tokbuf = malloc(sizeof(char*) * (size_t)(2 * (ntokens + nstages)));
+    pl->redirs = malloc(sizeof(redir_t) * (size_t)(ntokens + 1));
+    if (pl->stages == NULL || pl->tokbuf == NULL || pl->redirs == NULL) {
+        perror("malloc");
+        free_pipeline(pl);
+        return -1;
+    }
+
+    stage_t *stages = pl->stages;
+    char **tok = pl->tokbuf;
+    char **argvbuf = pl->tokbuf + ntokens + nstages;
+    redir_t *redirs = pl->redirs;
+    int ti = 0;
+
+    for (int s = 0; s < nstages; ++s) {
+        char **stage_tokens = tok + ti;
+        int n = 0;
+        while (*arglist != NULL && strcmp(*arglist, "|") != 0) {
+            stage_tokens[n++] = *arglist++;
+        }
+        if (*arglist != NULL) arglist++;   /* skip '|' */
+        stage_tokens[n] = NULL;
+        ti += n + 1;
+
+        /* For pipes, background semantics apply to the whole pipeline
+           ("a & | b" or "a | b &" both background the pipeline). */
+        if (!pl->background && detect_background(stage_tokens)) pl->background = 1;
+
+        stages[s].argv = argvbuf;
+        stages[s].redirs = redirs;
+        if (parse_side(stage_tokens, &stages[s]) != 0) {
+            free_pipeline(pl);   /* already reported */
             return -1;
         }
+        argvbuf += n + 1;
+        redirs += stages[s].nredirs;
 
-        pid_t left_pid = fork();
-        if (left_pid < 0) {
-            perror("fork");
-            close(pipefd[0]); close(pipefd[1]);
+        if (stages[s].argv[0] == NULL && stages[s].nredirs > 0) {
+            stages[s].argv[0] = "<redirect>";
+            stages[s].argv[1] = NULL;
+            stages[s].builtin = redirect_stage(&stages[s], s < nstages - 1 || piped_output);
+            continue;
+        }
+        if (stages[s].argv[0] == NULL) {
+            if (nstages > 1)
+                fprintf(stderr, "syntax error: invalid command in pipeline stage %d\n", s + 1);
+            else
+                fprintf(stderr, "syntax error: no command to execute\n");
+            free_pipeline(pl);
             return -1;
         }
+        stages[s].builtin = find_builtin(stages[s].argv[0]);
+    }
+    return 0;
+}
 
-        if (left_pid == 0) {
-            if (dup2(pipefd[1], STDOUT_FILENO) < 0) {
-                perror("dup2 pipe write");
-                _exit(1);
-            }
-            close(pipefd[0]);
-            close(pipefd[1]);
-
-            if (left_in != NULL) {
-                int fdin = open(left_in, O_RDONLY);
-                if (fdin < 0) {
-                    perror("open input file (left)");
-                    _exit(1);
-                }
-                dup2(fdin, STDIN_FILENO);
-                close(fdin);
-            }
-            if (left_out != NULL) {
-                int fdout = open(left_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fdout < 0) {
-                    perror("open output file (left)");
-                    _exit(1);
-                }
-                dup2(fdout, STDOUT_FILENO);
-                close(fdout);
-            }
+int execute_single(char* arglist[]) {
+    if (arglist == NULL || arglist[0] == NULL) return 0;
+
+    pipeline_t pl;
+    if (parse_pipeline(arglist, &pl) != 0) return 2;
+
+    int rc;
+    /* a lone foreground builtin runs without any fork */
+    if (pl.nstages == 1 && !pl.background && pl.stages[0].builtin != NULL)
+        rc = run_builtin_inline(&pl.stages[0]);
+    else
+        rc = run_pipeline(&pl, arglist);
+
+    free_pipeline(&pl);
+    return rc;
+}
+
+/* Start a command line as a job without waiting for it or printing the
+   usual "[n] pid" notice ('&' is implied). Returns the job id, or -1. */
+int execute_async(char* arglist[]) {
+    if (arglist == NULL || arglist[0] == NULL) return -1;
+
+    char cmd[JOB_CMD_LEN];
+    join_tokens(arglist, cmd, sizeof(cmd));
+
+    pipeline_t pl;
+    if (parse_pipeline(arglist, &pl) != 0) return -1;
+
+    int jid = -1;
+    pid_t *pids = calloc((size_t)pl.nstages, sizeof(pid_t));
+    if (pids == NULL) {
+        perror("calloc");
+    } else {
+        int failed;
+        int started = start_pipeline(&pl, pids, &failed, -1, -1);
+        /* a failed start is -1 at once; any stages that did start are
+           left to reap_zombies rather than waited for here */
+        if (!failed)
+            jid = add_job(pids, started, cmd);
+        free(pids);
+    }
+    free_pipeline(&pl);
+    return jid;
+}
+
+/* Move fd above the range scripts use for their own redirections,
+   keeping it close-on-exec; returns the new fd (fd is consumed) */
+static int park_fd(int fd) {
+    int nfd = fcntl(fd, F_DUPFD_CLOEXEC, 60);
+    if (nfd < 0) return fd;
+    close(fd);
+    return nfd;
+}
+
+/* Start arglist as a coprocess NAME: a job whose stdin and stdout are
+   pipes to the shell. The shell's ends are published as $NAME_WRITE
+   (feeds the coprocess' stdin) and $NAME_READ (its output), for use as
+   `cmd >&$NAME_WRITE` / `read line <&$NAME_READ`, and the first pid as
+   $NAME_PID. Both fds are close-on-exec, so commands started later never
+   hold them; the job table closes them when the job is reaped (stop a
+   helper with `kill $NAME_PID`). Returns the job id, or -1. */
+int execute_coproc(const char *name, char *arglist[]) {
+    if (arglist == NULL || arglist[0] == NULL) return -1;
+
+    char cmd[JOB_CMD_LEN];
+    snprintf(cmd, sizeof(cmd), "coproc %s ", name);
+    join_tokens(arglist, cmd + strlen(cmd), sizeof(cmd) - strlen(cmd));
+
+    pipeline_t pl;
+    if (parse_pipeline(arglist, &pl) != 0) return -1;
+
+    int to[2], from[2];
+    if (pipe2(to, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        free_pipeline(&pl);
+        return -1;
+    }
+    if (pipe2(from, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        close(to[0]);
+        close(to[1]);
+        free_pipeline(&pl);
+        return -1;
+    }
+
+    int jid = -1;
+    int failed = 1, started = 0;
+    pid_t *pids = calloc((size_t)pl.nstages, sizeof(pid_t));
+    if (pids == NULL)
+        perror("calloc");
+    else
+        started = start_pipeline(&pl, pids, &failed, to[0], from[1]);
+    close(to[0]);
+    close(from[1]);
+
+    if (!failed) jid = add_job(pids, started, cmd);
+    if (jid < 0) {
+        close(to[1]);
+        close(from[0]);
+        if (started > 0) wait_pipeline(pids, started);
+    } else {
+        int rfd = park_fd(from[0]), wfd = park_fd(to[1]);
+        job_attach_coproc(jid, name, rfd, wfd);
+
+        char var[256], num[32];
+        snprintf(var, sizeof(var), "%s_READ", name);
+        snprintf(num, sizeof(num), "%d", rfd);
+        set_var(var, num);
+        snprintf(var, sizeof(var), "%s_WRITE", name);
+        snprintf(num, sizeof(num), "%d", wfd);
+        set_var(var, num);
+        snprintf(var, sizeof(var), "%s_PID", name);
+        snprintf(num, sizeof(num), "%d", (int)pids[0]);
+        set_var(var, num);
+        printf("[%d] %d\n", jid, (int)pids[started - 1]);
+    }
+    free(pids);
+    free_pipeline(&pl);
+    return jid;
+}
+
+/* Call run(arg), then print its wall time and the resource usage of
+   everything it ran: the children reaped in the meantime plus the
+   shell's own CPU for in-process builtins. max RSS is the largest
+   child's, or the shell's when no child ran. An enclosing `time` still
+   gets the children counted here. */
+int run_timed(int (*run)(void *arg), void *arg) {
+    struct timespec start;
+    struct rusage self0, self1;
+    struct rusage outer = fg_usage;
+    int outer_reaped = fg_reaped;
+    getrusage(RUSAGE_SELF, &self0);
+    memset(&fg_usage, 0, sizeof(fg_usage));
+    fg_reaped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int rc = run(arg);
+
+    double real = elapsed_since(&start);
+    getrusage(RUSAGE_SELF, &self1);
+    struct rusage total = fg_usage;
+    timersub(&self1.ru_utime, &self0.ru_utime, &self1.ru_utime);
+    timersub(&self1.ru_stime, &self0.ru_stime, &self1.ru_stime);
+    self1.ru_minflt -= self0.ru_minflt;
+    self1.ru_majflt -= self0.ru_majflt;
+    self1.ru_nvcsw -= self0.ru_nvcsw;
+    self1.ru_nivcsw -= self0.ru_nivcsw;
+    if (fg_reaped > 0) self1.ru_maxrss = 0;
+    rusage_add(&total, &self1);
+    print_time_report(real, &total);
+
+    rusage_add(&outer, &fg_usage);
+    fg_usage = outer;
+    fg_reaped += outer_reaped;
+    return rc;
+}
+
+static int run_single(void *arglist) {
+    return execute_single(arglist);
+}
+
+/* `time cmd`: execute_single under run_timed */
+int execute_timed(char* arglist[]) {
+    return run_timed(run_single, arglist);
+}
+
+/* Exit status of the most recent command, for $? */
+static int last_status = 0;
+
+int get_last_status(void) {
+    return last_status;
+}
+
+void set_last_status(int status) {
+    last_status = status;
+}
+
+/* ------------------- command substitution ------------------- */
+
+/* Status of the most recent $(...) in the word being expanded, for
+   assignments like x=$(cmd) whose $? is that of cmd. */
+static int subst_ran = 0;
+static int subst_status = 0;
 
-            execvp(left_argv[0], left_argv);
-            perror("execvp (left)");
-            _exit(1);
+
+/* Read fd to EOF straight into the chunk's data, doubling it as needed.
+   The chunk is not linked anywhere yet, so it may move. */
+static arena_chunk_t* read_into_chunk(arena_chunk_t *c, int fd) {
+    while (1) {
+        if (c->cap - c->used < 4096 + 1) {
+            arena_chunk_t *nc = realloc(c, sizeof(arena_chunk_t) + c->cap * 2);
+            if (nc == NULL) {
+                perror("realloc");
+                break;
+            }
+            c = nc;
+            c->cap *= 2;
         }
+        ssize_t n = read(fd, c->data + c->used, c->cap - c->used - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        c->used += (size_t)n;
+    }
+    return c;
+}
 
-        pid_t right_pid = fork();
-        if (right_pid < 0) {
-            perror("fork");
-            close(pipefd[0]); close(pipefd[1]);
-            return -1;
+/* Lone builtin without redirections: run it in the shell with stdout
+   pointed at a memory stream. */
+static arena_chunk_t* capture_builtin(arena_chunk_t *c, builtin_fn fn, char **argv, int *status) {
+    char *mbuf = NULL;
+    size_t mlen = 0;
+    fflush(stdout);
+    FILE *mem = open_memstream(&mbuf, &mlen);
+    if (mem == NULL) {
+        perror("open_memstream");
+        *status = 1;
+        return c;
+    }
+    FILE *saved = stdout;
+    stdout = mem;
+    *status = fn(argv);
+    fclose(mem);
+    stdout = saved;
+
+    if (c->cap < mlen + 1) {
+        arena_chunk_t *nc = realloc(c, sizeof(arena_chunk_t) + mlen + 1);
+        if (nc == NULL) {
+            perror("realloc");
+            free(mbuf);
+            return c;
         }
+        c = nc;
+        c->cap = mlen + 1;
+    }
+    memcpy(c->data, mbuf, mlen);
+    c->used = mlen;
+    free(mbuf);
+    return c;
+}
 
-        if (right_pid == 0) {
-            if (dup2(pipefd[0], STDIN_FILENO) < 0) {
-                perror("dup2 pipe read");
-                _exit(1);
-            }
-            close(pipefd[0]);
-            close(pipefd[1]);
-
-            if (right_in != NULL) {
-                int fdin = open(right_in, O_RDONLY);
-                if (fdin < 0) {
-                    perror("open input file (right)");
-                    _exit(1);
-                }
-                dup2(fdin, STDIN_FILENO);
-                close(fdin);
+/* No list separator, and no '&' except inside a redirection operator
+   ("2>&1", "&>") */
+static int single_pipeline(const char *cmd) {
+    list_op_t op;
+    find_list_op(cmd, &op);
+    if (op != LIST_END) return 0;
+    for (const char *p = strchr(cmd, '&'); p != NULL; p = strchr(p + 1, '&'))
+        if (!(p > cmd && (p[-1] == '<' || p[-1] == '>')) && p[1] != '>') return 0;
+    return 1;
+}
+
+/* Run cmd with its stdout on a pipe and collect the output in a fresh
+   chunk (NUL-terminated, trailing newlines stripped). A single pipeline
+   is started with the usual launch backend, its last stage writing into
+   the pipe; a pure builtin needs no process at all. Lists (';', '&&',
+   '||', '&'), compound commands and assignments need the shell itself,
+   so those fork and run the text through script_run. */
+static arena_chunk_t* capture_output(char *cmd, int *status) {
+    arena_chunk_t *c = arena_new_chunk(4096);
+    if (c == NULL) {
+        perror("malloc");
+        *status = 1;
+        return NULL;
+    }
+    *status = 0;
+
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        *status = 1;
+        c->data[0] = '\0';
+        return c;
+    }
+    size_pipe(p[1]);
+
+    tokens_t *toks = NULL;
+    int simple = single_pipeline(cmd);
+    if (simple && (toks = tokenize(cmd)) != NULL) {
+        expand_tokens(toks);
+        if (toks->argv[0] != NULL && strchr(toks->argv[0], '=') != NULL) simple = 0;
+    }
+
+    if (simple && toks != NULL && toks->argv[0] != NULL) {
+        pipeline_t pl;
+        if (parse_pipeline(toks->argv, &pl) != 0) {
+            *status = 2;
+        } else {
+            builtin_fn fn = NULL;
+            if (pl.nstages == 1 && pl.stages[0].nredirs == 0)
+                fn = find_pure_builtin(pl.stages[0].argv[0]);
+            if (fn != NULL) {
+                close(p[1]);
+                p[1] = -1;
+                c = capture_builtin(c, fn, pl.stages[0].argv, status);
+            } else {
+                pid_t *pids = calloc((size_t)pl.nstages, sizeof(pid_t));
+                int failed = 1, started = 0;
+                if (pids != NULL) started = start_pipeline(&pl, pids, &failed, -1, p[1]);
+                close(p[1]);
+                p[1] = -1;
+                c = read_into_chunk(c, p[0]);
+                *status = wait_pipeline(pids, started);
+                if (failed) *status = 127;
+                free(pids);
             }
-            if (right_out != NULL) {
-                int fdout = open(right_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fdout < 0) {
-                    perror("open output file (right)");
-                    _exit(1);
-                }
-                dup2(fdout, STDOUT_FILENO);
-                close(fdout);
+            free_pipeline(&pl);
+        }
+    } else if (!simple) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(p[1], STDOUT_FILENO);
+            child_reset_signals();
+            /* the text runs like a script: lists, if/for/while blocks */
+            script_reader_t *r = script_open_string(cmd);
+            int rc = r ? script_run(r) : 1;
+            script_close(r);
+            fflush(stdout);
+            _exit(rc & 0xff);
+        }
+        close(p[1]);
+        p[1] = -1;
+        if (pid < 0) {
+            perror("fork");
+            *status = 1;
+        } else {
+            c = read_into_chunk(c, p[0]);
+            int ws = 0;
+            struct rusage ru;
+            pid_t w;
+            while ((w = wait4(pid, &ws, 0, &ru)) < 0 && errno == EINTR)
+                ;
+            if (w == pid) {
+                execute_note_usage(&ru);
+                *status = WIFEXITED(ws) ? WEXITSTATUS(ws) : 128 + WTERMSIG(ws);
+            } else {
+                perror("wait4");
+                *status = 1;
             }
+        }
+    }
+    free_tokens(toks);
+    if (p[1] != -1) close(p[1]);
+    close(p[0]);
+
+    while (c->used > 0 && c->data[c->used - 1] == '\n') c->used--;
+    c->data[c->used] = '\0';
+    return c;
+}
+
+/* Run the substitution of `span` bytes at p ("$(...)" or "`...`") */
+static arena_chunk_t* substitute(const char *p, size_t span) {
+    char *cmd = p[0] == '`' ? strndup(p + 1, span - 2) : strndup(p + 2, span - 3);
+    if (cmd == NULL) {
+        perror("strndup");
+        return NULL;
+    }
+    arena_chunk_t *c = capture_output(cmd, &subst_status);
+    subst_ran = 1;
+    free(cmd);
+    return c;
+}
+
+/* Push one finished word; an unquoted word with glob operators becomes
+   its sorted matches, or stays literal if nothing matches */
+static void push_word(tokens_t *t, char *s, int flags) {
+    if (!(flags & TOK_QUOTED) && has_glob_meta(s) && glob_push(t, s, flags) > 0) return;
+    tokens_push(t, s, flags);
+}
+
+/* Push s as one token, or, when splitting, as its blank-separated fields
+   (split in place; an empty result yields no token at all) */
+static void push_fields(tokens_t *t, char *s, int split, int flags) {
+    if (!split) {
+        push_word(t, s, flags);
+        return;
+    }
+    while (1) {
+        while (*s == ' ' || *s == '\t' || *s == '\n') s++;
+        if (*s == '\0') break;
+        char *start = s;
+        while (*s != '\0' && *s != ' ' && *s != '\t' && *s != '\n') s++;
+        int more = *s != '\0';
+        *s = '\0';
+        push_word(t, start, flags);
+        if (!more) break;
+        s++;
+    }
+}
 
-            execvp(right_argv[0], right_argv);
-            perror("execvp (right)");
-            _exit(1);
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void sb_append(strbuf_t *sb, const char *s, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        size_t ncap = sb->cap ? sb->cap * 2 : 128;
+        while (ncap < sb->len + n + 1) ncap *= 2;
+        char *nb = realloc(sb->buf, ncap);
+        if (nb == NULL) return;
+        sb->buf = nb;
+        sb->cap = ncap;
+    }
+    memcpy(sb->buf + sb->len, s, n);
+    sb->len += n;
+    sb->buf[sb->len] = '\0';
+}
+
+/* Expand $name, ${name}, $?, $(cmd) and `cmd` anywhere in word w and push
+   the result. Unquoted words that contained a substitution are split
+   into fields. w itself is never modified. */
+static void expand_word(tokens_t *t, char *w, int flags) {
+    int split = !(flags & TOK_QUOTED);
+    size_t span = subst_span(w);
+
+    if (span && w[span] == '\0') {
+        /* the whole word is one substitution: keep the captured buffer
+           and split it where it lies */
+        arena_chunk_t *c = substitute(w, span);
+        if (c == NULL) return;
+        tokens_adopt_chunk(t, c);
+        push_fields(t, c->data, split, flags);
+        return;
+    }
+
+    strbuf_t sb = { NULL, 0, 0 };
+    int substituted = 0;
+    sb_append(&sb, "", 0);
+    for (char *p = w; *p; ) {
+        if ((span = subst_span(p)) != 0) {
+            arena_chunk_t *c = substitute(p, span);
+            if (c != NULL) sb_append(&sb, c->data, c->used);
+            free(c);
+            substituted = 1;
+            p += span;
+        } else if (p[0] == '$' && p[1] == '?') {
+            char num[16];
+            int n = snprintf(num, sizeof(num), "%d", last_status);
+            sb_append(&sb, num, (size_t)n);
+            p += 2;
+        } else if (p[0] == '$' && (isalpha((unsigned char)p[1]) || p[1] == '_' || p[1] == '{')) {
+            int braced = p[1] == '{';
+            char *name = p + 1 + braced;
+            char *end = name;
+            while (isalnum((unsigned char)*end) || *end == '_') end++;
+            if (braced && *end != '}') {
+                sb_append(&sb, p, 1);   /* malformed ${...}: keep the '$' */
+                p++;
+                continue;
+            }
+            char nbuf[128];
+            size_t nlen = (size_t)(end - name);
+            if (nlen >= sizeof(nbuf)) nlen = sizeof(nbuf) - 1;
+            memcpy(nbuf, name, nlen);
+            nbuf[nlen] = '\0';
+            const char *val = get_var(nbuf);
+            if (val != NULL) sb_append(&sb, val, strlen(val));
+            p = end + braced;
+        } else {
+            char *next = p + 1;
+            while (*next != '\0' && *next != '$' && *next != '`') next++;
+            sb_append(&sb, p, (size_t)(next - p));
+            p = next;
         }
+    }
+
+    char *word = tokens_alloc(t, sb.len + 1);
+    if (word != NULL) {
+        memcpy(word, sb.buf ? sb.buf : "", sb.len + 1);
+        push_fields(t, word, split && substituted, flags);
+    }
+    free(sb.buf);
+}
 
-        close(pipefd[0]);
-        close(pipefd[1]);
+/* Does token i need expansion: '$' or '`' outside single quotes, glob
+   operators outside any quotes, or a here-document operator? */
+static int needs_expansion(const tokens_t *toks, int i) {
+    const char *w = toks->argv[i];
+    if (!(toks->flags[i] & TOK_LITERAL) && strpbrk(w, "$`") != NULL && strcmp(w, "$") != 0) return 1;
+    if (!(toks->flags[i] & TOK_QUOTED) && has_glob_meta(w)) return 1;
+    int fd;
+    return !(toks->flags[i] & TOK_QUOTED) && redir_op(w, &fd) == REDIR_HEREDOC;
+}
+
+/* Expand every token that needs it (see needs_expansion). argv is rebuilt
+   from the first such token on, since one word may become several fields
+   or none; toks->argv may move. */
+void expand_tokens(tokens_t *toks) {
+    int n = toks->argc;
+    int i = 0;
+    while (i < n && !needs_expansion(toks, i))
+        i++;
+    if (i == n) return;
 
-        if (pipeline_background) {
-            /* For a background pipeline, add the pipeline's rightmost pid as the job pid */
-            char cmd[JOB_CMD_LEN];
-            join_tokens(arglist, cmd, sizeof(cmd));
-            int jid = add_job(right_pid, cmd);
-            if (jid >= 0)
-                printf("[%d] %d\n", jid, (int)right_pid);
+    int rest = n - i;
+    char **words = malloc((sizeof(char*) + 1) * (size_t)rest);
+    if (words == NULL) {
+        perror("malloc");
+        return;
+    }
+    unsigned char *wflags = (unsigned char*)(words + rest);
+    memcpy(words, toks->argv + i, sizeof(char*) * (size_t)rest);
+    memcpy(wflags, toks->flags + i, (size_t)rest);
+    toks->argc = i;
+    toks->argv[i] = NULL;
+
+    for (int k = 0; k < rest; ++k) {
+        int fd;
+        int prev_op = k > 0 && !(wflags[k - 1] & TOK_QUOTED) ? redir_op(words[k - 1], &fd) : -1;
+        if (prev_op == REDIR_HEREDOC) {
+            /* here-document marker -> body, expanded unless the delimiter was quoted */
+            int expand = 0;
+            const char *body = heredoc_body(words[k], &expand);
+            if (body == NULL) {
+                fprintf(stderr, "warning: here-document '%s' has no body\n", words[k]);
+                body = "";
+            }
+            char *copy;
+            if (expand && strpbrk(body, "$`") != NULL && (copy = tokens_strdup(toks, body)) != NULL)
+                expand_word(toks, copy, TOK_QUOTED);
             else
-                printf("[?] %d\n", (int)right_pid);
-            /* don't wait */
-            return 0;
+                tokens_push(toks, (char*)body, TOK_QUOTED | TOK_LITERAL);
+        } else if (!(wflags[k] & TOK_LITERAL) && strpbrk(words[k], "$`") != NULL) {
+            /* a here-string is one word, never split */
+            expand_word(toks, words[k], prev_op == REDIR_HERESTR ? TOK_QUOTED : wflags[k]);
+        } else if (prev_op >= 0) {
+            tokens_push(toks, words[k], wflags[k]);   /* redirection target */
         } else {
-            int status;
-            waitpid(left_pid, &status, 0);
-            waitpid(right_pid, &status, 0);
-            return 0;
+            push_word(toks, words[k], wflags[k]);
+        }
+    }
+    free(words);
+}
+
+/* ===========================================================
+ *  Function: execute_tokens
+ *  Purpose:  Run one tokenized command the way the main loop does:
+ *            NAME=value assignment, expansion, then execute_single
+ *            (which also dispatches builtins). The token strings are
+ *            only read, so a pre-parsed command (see tokens_share)
+ *            can run again. Returns the status, which becomes $?.
+ * =========================================================== */
+int execute_tokens(tokens_t *toks) {
+    int status = 0;
+
+    /* ---------- ASSIGNMENT ---------- */
+    char *eq = strchr(toks->argv[0], '=');
+    if (eq != NULL && toks->argv[1] == NULL && !(toks->flags[0] & TOK_QUOTED)) {
+        size_t nlen = (size_t)(eq - toks->argv[0]);
+        char *name = tokens_alloc(toks, nlen + 1);
+        if (name != NULL) {
+            memcpy(name, toks->argv[0], nlen);
+            name[nlen] = '\0';
         }
+        if (name != NULL && is_valid_name(name)) {
+            /* the value is expanded as one field; $? comes from a $(...) in it */
+            subst_ran = 0;
+            toks->argc = 0;
+            uint64_t t0 = trace_start();
+            expand_word(toks, eq + 1, TOK_QUOTED);
+            trace_stop(TR_EXPAND, t0);
+            const char *value = toks->argc > 0 ? toks->argv[0] : "";
+            status = set_var(name, value) == 0 ? (subst_ran ? subst_status : 0) : 1;
+            last_status = status;
+            if (trace_fd >= 0) {
+                char *shown[] = { name, NULL };
+                trace_command(shown, status);
+            }
+            return status;
+        }
+    }
+
+    /* ---------- EXPANSION ---------- */
+    uint64_t t0 = trace_start();
+    expand_tokens(toks);
+    trace_stop(TR_EXPAND, t0);
+
+    /* ---------- Builtins & Execution ---------- */
+    /* an unquoted leading `time` times the whole pipeline */
+    if (toks->argv[0] != NULL && strcmp(toks->argv[0], "time") == 0 && !(toks->flags[0] & TOK_QUOTED))
+        status = execute_timed(toks->argv + 1);
+    else
+        status = execute_single(toks->argv);
+    last_status = status;
+    if (trace_fd >= 0) trace_command(toks->argv, status);
+    return status;
+}
+
+/* execute_command: tokenize one ';'-free command and run it */
+int execute_command(char *cmd) {
+    tokens_t *toks = tokenize(cmd);
+    if (toks == NULL) return last_status;
+    int status = execute_tokens(toks);
+    free_tokens(toks);
+    return status;
+}
+
+/* A list or compound command started as a job: a forked shell runs the
+   text the way script_run runs a script, and is the job's one process */
+static int execute_list_async(char *cmd) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        child_reset_signals();
+        script_reader_t *r = script_open_string(cmd);
+        int rc = r ? script_run(r) : 1;
+        script_close(r);
+        fflush(stdout);
+        _exit(rc & 0xff);
     }
+    char shown[JOB_CMD_LEN];
+    snprintf(shown, sizeof(shown), "%s", cmd);
+    return add_job(&pid, 1, shown);
+}
+
+/* execute_command_async: like execute_command, but the command is started
+   as a job (see execute_async) and its job id returned (-1 on error).
+   Anything but a single pipeline ("a; b", "x && y", a for loop: all
+   need a separator) runs in a forked shell (execute_list_async). */
+int execute_command_async(char *cmd) {
+    if (!single_pipeline(cmd)) return execute_list_async(cmd);
+    tokens_t *toks = tokenize(cmd);
+    if (toks == NULL) return -1;
+    uint64_t t0 = trace_start();
+    expand_tokens(toks);
+    trace_stop(TR_EXPAND, t0);
+    int jid = execute_async(toks->argv);
+    if (trace_fd >= 0) trace_command(toks->argv, jid < 0 ? 127 : 0);
+    free_tokens(toks);
+    return jid;
 }
 
 /* ===========================================================
  *  Function: execute_chained_input
- *  Purpose:  Split a full input line into commands separated
- *            by ';' and execute each sequentially.
+ *  Purpose:  Split a full input line into commands separated by
+ *            ';', '&&' or '||' (see find_list_op) and run them left
+ *            to right. A command after '&&' runs only if the status
+ *            so far is 0, after '||' only if it is non-zero; skipped
+ *            commands are never tokenized or forked and leave the
+ *            status unchanged. Returns the status of the last
+ *            command run.
  * =========================================================== */
 int execute_chained_input(char *input_line) {
     if (input_line == NULL) return 0;
 
-    char *saveptr = NULL;
-    char *segment = strtok_r(input_line, ";", &saveptr);
+    list_op_t op = LIST_SEQ, next;
+    int status = last_status;
+    char *segment = input_line;
 
-    while (segment != NULL) {
-        // trim leading/trailing spaces
-        while (*segment == ' ' || *segment == '\t') segment++;
-        char *end = segment + strlen(segment) - 1;
-        while (end > segment && (*end == ' ' || *end == '\t')) {
-            *end = '\0';
-            end--;
-        }
+    while (1) {
+        char *p = find_list_op(segment, &next);
+        char *after = p + list_op_len(next);
+        *p = '\0';
 
-        if (*segment != '\0') {
-            // Tokenize and execute this subcommand
-            char **arglist = tokenize(segment);
-            if (arglist != NULL) {
-                execute_single(arglist); // call single-command executor
-                for (int i = 0; arglist[i] != NULL; i++)
-                    free(arglist[i]);
-                free(arglist);
-            }
+        int run = op == LIST_SEQ || (op == LIST_AND && status == 0) || (op == LIST_OR && status != 0);
+        if (run) {
+            // trim leading/trailing spaces
+            while (*segment == ' ' || *segment == '\t') segment++;
+            char *end = segment + strlen(segment);
+            while (end > segment && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+
+            if (*segment != '\0')
+                status = execute_command(segment);
         }
 
-        segment = strtok_r(NULL, ";", &saveptr);
+        if (next == LIST_END) break;
+        op = next;
+        segment = after;
     }
 
-    return 0;
+    return status;
+}
+
+int list_op_len(list_op_t op) {
+    return op == LIST_SEQ ? 1 : op == LIST_END ? 0 : 2;
+}
+
+/* Next ';', newline, '&&' or '||' at or after p, outside quotes and
+   $(...) / `...`. Returns a pointer to it (or to the terminating NUL,
+   with LIST_END) and stores its kind in *op. */
+char* find_list_op(const char *p, list_op_t *op) {
+    char quote = 0;
+    size_t span;
+
+    for (;; ++p) {
+        if (*p == '\0') {
+            *op = LIST_END;
+            break;
+        }
+        if (quote != '\'' && (span = subst_span(p)) != 0) {
+            p += span - 1;   /* a $(...) keeps its ';', '&&', '||' */
+        } else if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == ';' || *p == '\n') {
+            *op = LIST_SEQ;
+            break;
+        } else if (p[0] == '&' && p[1] == '&') {
+            *op = LIST_AND;
+            break;
+        } else if (p[0] == '|' && p[1] == '|') {
+            *op = LIST_OR;
+            break;
+        }
+    }
+    return (char*)p;
 }
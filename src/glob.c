@@ -0,0 +1,318 @@
+/* src/glob.c
+ * Pathname expansion for unquoted words containing '*', '?' or '[...]'.
+ *
+ * Each directory a pattern needs is read once with getdents64 into a
+ * single name pool, sorted, and kept in a small LRU cache keyed by path
+ * and validated by the directory's stat (dev, inode, mtime, ctime,
+ * size), so a glob repeated in a loop or script costs one stat. A pattern component's
+ * literal prefix is binary-searched in the sorted listing, the rest is
+ * matched with fnmatch, and the matches are copied into the token arena
+ * in one block. No step is worse than O(n log n) in the directory size.
+ */
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define GLOB_CACHE_DIRS 32
+#define GETDENTS_BUF (64 * 1024)
+
+/* Coarsest directory timestamp granularity to allow for (FAT: 2 s). A
+   listing read less than this after the directory's last change may
+   miss an entry added in the same tick, which leaves the timestamps
+   unchanged, so such a listing is never reused. */
+#define GLOB_RACY_NS 2000000000LL
+
+struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct {
+    char *dir;               /* NULL => free slot */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec ctime;
+    off_t size;
+    int racy;                /* read too close to mtime to be trusted */
+    char *pool;              /* NUL-separated names */
+    size_t *names;           /* offsets into pool, sorted by name */
+    size_t n;
+    unsigned long used;      /* LRU clock */
+} dir_listing_t;
+
+static dir_listing_t cache[GLOB_CACHE_DIRS];
+static unsigned long cache_clock = 0;
+
+/* Growable list of paths sharing one pool */
+typedef struct {
+    char *pool;
+    size_t len, cap;
+    size_t *offs;
+    size_t n, ncap;
+} pathlist_t;
+
+static int pl_add(pathlist_t *pl, const char *prefix, size_t plen, const char *name) {
+    size_t nlen = strlen(name);
+    size_t need = plen + nlen + 1;
+    if (pl->len + need > pl->cap) {
+        size_t ncap = pl->cap ? pl->cap * 2 : 4096;
+        while (ncap < pl->len + need) ncap *= 2;
+        char *np = realloc(pl->pool, ncap);
+        if (np == NULL) return -1;
+        pl->pool = np;
+        pl->cap = ncap;
+    }
+    if (pl->n == pl->ncap) {
+        size_t ncap = pl->ncap ? pl->ncap * 2 : 64;
+        size_t *no = realloc(pl->offs, sizeof(size_t) * ncap);
+        if (no == NULL) return -1;
+        pl->offs = no;
+        pl->ncap = ncap;
+    }
+    pl->offs[pl->n++] = pl->len;
+    memcpy(pl->pool + pl->len, prefix, plen);
+    memcpy(pl->pool + pl->len + plen, name, nlen + 1);
+    pl->len += need;
+    return 0;
+}
+
+static void pl_free(pathlist_t *pl) {
+    free(pl->pool);
+    free(pl->offs);
+    memset(pl, 0, sizeof(*pl));
+}
+
+static const char *sort_pool;   /* qsort has no context argument */
+
+static int cmp_offsets(const void *a, const void *b) {
+    return strcmp(sort_pool + *(const size_t*)a, sort_pool + *(const size_t*)b);
+}
+
+static void drop_listing(dir_listing_t *d) {
+    free(d->dir);
+    free(d->pool);
+    free(d->names);
+    memset(d, 0, sizeof(*d));
+}
+
+/* Read dir with getdents64 into d (all but "." and ".."), sorted */
+static int read_listing(const char *dir, dir_listing_t *d) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    char *buf = malloc(GETDENTS_BUF);
+    pathlist_t pl = { 0 };
+    int rc = buf ? 0 : -1;
+    while (rc == 0) {
+        long nread = syscall(SYS_getdents64, fd, buf, GETDENTS_BUF);
+        if (nread <= 0) {
+            if (nread < 0) rc = -1;
+            break;
+        }
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *e = (struct linux_dirent64*)(buf + off);
+            off += e->d_reclen;
+            const char *nm = e->d_name;
+            if (nm[0] == '.' && (nm[1] == '\0' || (nm[1] == '.' && nm[2] == '\0'))) continue;
+            if (pl_add(&pl, "", 0, nm) != 0) {
+                rc = -1;
+                break;
+            }
+        }
+    }
+    free(buf);
+    close(fd);
+    if (rc != 0) {
+        pl_free(&pl);
+        return -1;
+    }
+
+    sort_pool = pl.pool;
+    qsort(pl.offs, pl.n, sizeof(size_t), cmp_offsets);
+    d->pool = pl.pool;
+    d->names = pl.offs;
+    d->n = pl.n;
+    return 0;
+}
+
+static int same_time(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+/* Cached sorted listing of dir, re-read if the directory changed */
+static dir_listing_t* get_listing(const char *dir) {
+    struct stat sb;
+    if (stat(dir, &sb) != 0 || !S_ISDIR(sb.st_mode)) return NULL;
+
+    dir_listing_t *victim = &cache[0];
+    for (int i = 0; i < GLOB_CACHE_DIRS; ++i) {
+        dir_listing_t *d = &cache[i];
+        if (d->dir != NULL && strcmp(d->dir, dir) == 0) {
+            if (!d->racy && d->dev == sb.st_dev && d->ino == sb.st_ino && d->size == sb.st_size &&
+                same_time(&d->mtime, &sb.st_mtim) && same_time(&d->ctime, &sb.st_ctim)) {
+                d->used = ++cache_clock;
+                return d;
+            }
+            victim = d;   /* stale: refill in place */
+            break;
+        }
+        if (d->dir == NULL || d->used < victim->used) victim = d;
+    }
+
+    struct timespec read_at;
+    clock_gettime(CLOCK_REALTIME, &read_at);
+    drop_listing(victim);
+    if (read_listing(dir, victim) != 0) return NULL;
+    victim->dir = strdup(dir);
+    if (victim->dir == NULL) {
+        drop_listing(victim);
+        return NULL;
+    }
+    victim->dev = sb.st_dev;
+    victim->ino = sb.st_ino;
+    victim->mtime = sb.st_mtim;
+    victim->ctime = sb.st_ctim;
+    victim->size = sb.st_size;
+    victim->racy = (read_at.tv_sec - sb.st_mtim.tv_sec) * 1000000000LL +
+                   (read_at.tv_nsec - sb.st_mtim.tv_nsec) < GLOB_RACY_NS;
+    victim->used = ++cache_clock;
+    return victim;
+}
+
+/* Index of the first name >= key */
+static size_t lower_bound(const dir_listing_t *d, const char *key) {
+    size_t lo = 0, hi = d->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(d->pool + d->names[mid], key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Does s contain an unquoted glob operator? A '[' only counts with a
+   closing ']', so "[" and "a[" stay literal without any directory read. */
+int has_glob_meta(const char *s) {
+    for (; *s; ++s) {
+        if (*s == '*' || *s == '?') return 1;
+        if (*s == '[' && strchr(s + 1, ']') != NULL) return 1;
+    }
+    return 0;
+}
+
+/* Match one pattern component against every entry of each prefix
+   directory, appending prefix + name, plus '/' if more components follow
+   (more == 1) or the pattern ends in '/' (more == 2: directories only) */
+static int match_component(pathlist_t *in, pathlist_t *out, const char *comp, int more) {
+    size_t litlen = strcspn(comp, "*?[");
+    char lit[256];
+    if (litlen >= sizeof(lit)) litlen = sizeof(lit) - 1;
+    memcpy(lit, comp, litlen);
+    lit[litlen] = '\0';
+
+    for (size_t i = 0; i < in->n; ++i) {
+        const char *prefix = in->pool + in->offs[i];
+        size_t plen = strlen(prefix);
+        char dir[4096];
+        if (plen == 0) {
+            strcpy(dir, ".");
+        } else if (plen < sizeof(dir)) {
+            memcpy(dir, prefix, plen + 1);
+        } else {
+            continue;
+        }
+        dir_listing_t *d = get_listing(dir);
+        if (d == NULL) continue;
+
+        for (size_t k = lower_bound(d, lit); k < d->n; ++k) {
+            const char *name = d->pool + d->names[k];
+            if (strncmp(name, lit, litlen) != 0) break;
+            if (fnmatch(comp, name, FNM_PERIOD) != 0) continue;
+            if (more) {
+                char path[4096];
+                if (snprintf(path, sizeof(path), "%s%s/", prefix, name) >= (int)sizeof(path)) continue;
+                struct stat sb;
+                if (more == 2 && (stat(path, &sb) != 0 || !S_ISDIR(sb.st_mode))) continue;
+                if (pl_add(out, path, strlen(path), "") != 0) return -1;
+            } else if (pl_add(out, prefix, plen, name) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Expand pattern into sorted matching paths pushed onto t (copied into
+   the arena in one block). Returns the number pushed; 0 => no match and
+   nothing pushed (the caller keeps the word as is). */
+int glob_push(tokens_t *t, const char *pattern, int flags) {
+    char *pat = strdup(pattern);
+    if (pat == NULL) return 0;
+
+    pathlist_t cur = { 0 }, next = { 0 };
+    char *p = pat;
+    if (*p == '/') {
+        while (*p == '/') p++;
+        pl_add(&cur, "/", 1, "");
+    } else {
+        pl_add(&cur, "", 0, "");
+    }
+
+    int multi = 0;      /* more than one directory contributed */
+    while (cur.n > 0 && *p != '\0') {
+        char *slash = strchr(p, '/');
+        if (slash != NULL) *slash = '\0';
+        int more = slash != NULL && slash[1] != '\0';
+        int trailing = slash != NULL && !more;   /* a final '/' matches directories only */
+
+        if (has_glob_meta(p)) {
+            /* one directory's matches come out sorted; anything else is re-sorted */
+            if (cur.n > 1 || slash != NULL) multi = 1;
+            if (match_component(&cur, &next, p, more ? 1 : trailing ? 2 : 0) != 0) break;
+        } else {
+            /* literal component: keep prefixes where it exists */
+            for (size_t i = 0; i < cur.n; ++i) {
+                char path[4096];
+                const char *prefix = cur.pool + cur.offs[i];
+                if (snprintf(path, sizeof(path), "%s%s%s", prefix, p, more || trailing ? "/" : "")
+                    >= (int)sizeof(path))
+                    continue;
+                if (access(path, F_OK) == 0) pl_add(&next, path, strlen(path), "");
+            }
+        }
+        pl_free(&cur);
+        cur = next;
+        memset(&next, 0, sizeof(next));
+        if (slash == NULL) break;
+        p = slash + 1;
+        while (*p == '/') p++;
+    }
+    pl_free(&next);
+    free(pat);
+
+    int pushed = 0;
+    if (cur.n > 0) {
+        if (multi) {
+            sort_pool = cur.pool;
+            qsort(cur.offs, cur.n, sizeof(size_t), cmp_offsets);
+        }
+        char *base = tokens_alloc(t, cur.len);
+        if (base != NULL) {
+            memcpy(base, cur.pool, cur.len);
+            for (size_t i = 0; i < cur.n; ++i) {
+                if (tokens_push(t, base + cur.offs[i], flags | TOK_QUOTED) != 0) break;
+                pushed++;
+            }
+        }
+    }
+    pl_free(&cur);
+    return pushed;
+}
@@ -0,0 +1,175 @@
+/* src/heredoc.c
+ * Here-documents (`cmd <<EOF ... EOF`).
+ *
+ * The line readers (interactive loop, script mode) hand every input line
+ * to heredoc_collect(). For each `<<WORD` it reads the body lines up to
+ * WORD, stores the body here and rewrites WORD in the line to a private
+ * marker ("\001" + index). The marker survives ';'/'&&'/'||' splitting,
+ * if blocks and re-execution unchanged; expand_tokens turns it back into
+ * the body text. Bodies live until heredoc_clear() after the line ran.
+ */
+
+#include "shell.h"
+
+#define HEREDOC_MARK '\001'
+
+typedef struct {
+    char *body;
+    int expand;     /* unquoted delimiter: $var and $(cmd) are expanded */
+} heredoc_t;
+
+static heredoc_t *docs = NULL;
+static int ndocs = 0;
+static int docs_cap = 0;
+
+static int heredoc_add(char *body, int expand) {
+    if (ndocs == docs_cap) {
+        int ncap = docs_cap ? docs_cap * 2 : 8;
+        heredoc_t *nd = realloc(docs, sizeof(heredoc_t) * (size_t)ncap);
+        if (nd == NULL) return -1;
+        docs = nd;
+        docs_cap = ncap;
+    }
+    docs[ndocs].body = body;
+    docs[ndocs].expand = expand;
+    return ndocs++;
+}
+
+void heredoc_clear(void) {
+    for (int i = 0; i < ndocs; ++i) free(docs[i].body);
+    ndocs = 0;
+}
+
+/* Body for a marker word, or NULL if word is not one */
+const char* heredoc_body(const char *word, int *expand) {
+    if (word[0] != HEREDOC_MARK) return NULL;
+    char *end;
+    long id = strtol(word + 1, &end, 10);
+    if (*end != '\0' || id < 0 || id >= ndocs) return NULL;
+    *expand = docs[id].expand;
+    return docs[id].body;
+}
+
+/* Read body lines until one equals delim (after leading tabs with
+   <<-); returns the malloc'd body, every line '\n'-terminated. */
+static char* read_body(const char *delim, int strip_tabs, line_source_fn next, void *ctx) {
+    size_t len = 0, cap = 256;
+    char *body = malloc(cap);
+    if (body == NULL) return NULL;
+    body[0] = '\0';
+
+    char *line;
+    while ((line = next(ctx)) != NULL) {
+        char *s = line;
+        if (strip_tabs) while (*s == '\t') s++;
+        if (strcmp(s, delim) == 0) {
+            free(line);
+            return body;
+        }
+        size_t n = strlen(s);
+        if (len + n + 2 > cap) {
+            while (len + n + 2 > cap) cap *= 2;
+            char *nb = realloc(body, cap);
+            if (nb == NULL) {
+                free(line);
+                free(body);
+                return NULL;
+            }
+            body = nb;
+        }
+        memcpy(body + len, s, n);
+        len += n;
+        body[len++] = '\n';
+        body[len] = '\0';
+        free(line);
+    }
+    fprintf(stderr, "warning: here-document delimited by end-of-file (wanted '%s')\n", delim);
+    return body;
+}
+
+/* Scan line for `<<WORD` / `<<-WORD` outside quotes (`<<<` is a
+   here-string and is left alone). Returns a malloc'd copy of the line
+   with each WORD replaced by its marker, or NULL if there was none. */
+char* heredoc_collect(const char *line, line_source_fn next, void *ctx) {
+    char *out = NULL;
+    size_t len = 0, cap = 0;
+    const char *copied = line;   /* line text up to here is already in out */
+    char quote = 0;
+
+    for (const char *p = line; *p; ++p) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+            continue;
+        }
+        if (*p == '"' || *p == '\'') {
+            quote = *p;
+            continue;
+        }
+        if (p[0] != '<' || p[1] != '<') continue;
+        if (p[2] == '<') {
+            p += 2;
+            continue;
+        }
+
+        const char *w = p + 2;
+        int strip_tabs = *w == '-';
+        if (strip_tabs) w++;
+        while (*w == ' ' || *w == '\t') w++;
+
+        /* delimiter word; any quoting turns expansion off */
+        char delim[256];
+        size_t dl = 0;
+        int expand = 1;
+        const char *e = w;
+        while (*e && *e != ' ' && *e != '\t' && *e != ';' && *e != '|' &&
+               *e != '&' && *e != '<' && *e != '>') {
+            if (*e == '"' || *e == '\'') {
+                char q = *e++;
+                expand = 0;
+                while (*e && *e != q) {
+                    if (dl < sizeof(delim) - 1) delim[dl++] = *e;
+                    e++;
+                }
+                if (*e) e++;
+                continue;
+            }
+            if (dl < sizeof(delim) - 1) delim[dl++] = *e;
+            e++;
+        }
+        delim[dl] = '\0';
+        if (dl == 0) continue;   /* parse_side reports the syntax error */
+
+        char *body = read_body(delim, strip_tabs, next, ctx);
+        if (body == NULL) {
+            perror("heredoc");
+            break;
+        }
+        int id = heredoc_add(body, expand);
+        if (id < 0) {
+            free(body);
+            break;
+        }
+
+        /* out += line[copied .. "<<"] + marker, then skip the word */
+        char mark[16];
+        int ml = snprintf(mark, sizeof(mark), "%c%d", HEREDOC_MARK, id);
+        size_t keep = (size_t)(p + 2 - copied);
+        size_t need = len + keep + (size_t)ml + strlen(e) + 1;
+        if (need > cap) {
+            cap = need * 2;
+            char *nb = realloc(out, cap);
+            if (nb == NULL) break;
+            out = nb;
+        }
+        memcpy(out + len, copied, keep);
+        len += keep;
+        memcpy(out + len, mark, (size_t)ml);
+        len += (size_t)ml;
+        copied = e;
+        p = e - 1;
+    }
+
+    if (out == NULL) return NULL;
+    strcpy(out + len, copied);
+    return out;
+}
@@ -0,0 +1,362 @@
+/* src/history.c
+ * Persistent command history.
+ *
+ * The history file ($HISTFILE, default ~/.myshell_history) is append
+ * only: one entry per line, newlines inside an entry stored as \036.
+ * At startup it is mapped MAP_PRIVATE and split in place, so loading
+ * 100k entries costs one pass and no copies. Entries live in a ring of
+ * HIST_DEFAULT_MAX slots (HISTSIZE overrides); entry n (1-based, counted
+ * from the first entry ever written) sits in slot (n-1) % cap, so
+ * appending and `!n` recall are O(1). Rotation drops old lines from the
+ * file and records how many in a leading "\036base N" line, so numbers
+ * stay the same across rotations.
+ *
+ * Substring search (history -s, Ctrl-R) goes through a trigram index:
+ * every entry is posted under each distinct 3-byte substring, and a
+ * query only verifies the entries of its rarest trigram. The index is
+ * built on first use and then kept up to date on append.
+ */
+
+#include "shell.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HIST_DEFAULT_MAX 100000
+#define HIST_NL '\036'            /* stands for '\n' inside the file */
+#define HIST_BASE "\036base "     /* first line: entries rotated away */
+
+typedef struct {
+    char *text;
+    int owned;        /* malloc'd (added this session) vs. in the mapping */
+} hist_slot_t;
+
+static hist_slot_t *ring = NULL;
+static long ring_cap = 0;
+static long last_id = 0;          /* number of the newest entry; 0 => none */
+static long count = 0;            /* entries held (<= ring_cap) */
+static int hist_fd = -1;
+static char *map = NULL;
+static size_t map_len = 0;
+
+/* ------------------- trigram index ------------------- */
+
+typedef struct {
+    uint32_t key;                 /* 0 => empty slot */
+    uint32_t n, cap;
+    uint32_t *ids;                /* ascending entry numbers */
+} posting_t;
+
+static posting_t *index_tab = NULL;
+static size_t index_cap = 0;      /* power of two */
+static size_t index_used = 0;
+static int index_built = 0;
+static long index_since = 0;      /* appends since the last (re)build */
+
+static uint32_t trigram(const char *s) {
+    return (uint32_t)(unsigned char)s[0] | (uint32_t)(unsigned char)s[1] << 8 |
+           (uint32_t)(unsigned char)s[2] << 16 | 1u << 24;
+}
+
+static posting_t* posting_find(uint32_t key, int create) {
+    if (create && (index_used + 1) * 2 > index_cap) {
+        size_t ncap = index_cap ? index_cap * 2 : 4096;
+        posting_t *nt = calloc(ncap, sizeof(posting_t));
+        if (nt == NULL) return NULL;
+        for (size_t i = 0; i < index_cap; ++i) {
+            if (index_tab[i].key == 0) continue;
+            size_t j = (index_tab[i].key * 2654435761u) & (ncap - 1);
+            while (nt[j].key != 0) j = (j + 1) & (ncap - 1);
+            nt[j] = index_tab[i];
+        }
+        free(index_tab);
+        index_tab = nt;
+        index_cap = ncap;
+    }
+    if (index_cap == 0) return NULL;
+    size_t j = (key * 2654435761u) & (index_cap - 1);
+    while (index_tab[j].key != 0 && index_tab[j].key != key) j = (j + 1) & (index_cap - 1);
+    if (index_tab[j].key == 0) {
+        if (!create) return NULL;
+        index_tab[j].key = key;
+        index_used++;
+    }
+    return &index_tab[j];
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void index_entry(long id, const char *text) {
+    size_t len = strlen(text);
+    if (len < 3) return;
+    uint32_t small[256];
+    uint32_t *keys = len - 2 <= 256 ? small : malloc(sizeof(uint32_t) * (len - 2));
+    if (keys == NULL) return;
+    for (size_t i = 0; i + 2 < len; ++i) keys[i] = trigram(text + i);
+    qsort(keys, len - 2, sizeof(uint32_t), cmp_u32);
+    for (size_t i = 0; i < len - 2; ++i) {
+        if (i > 0 && keys[i] == keys[i - 1]) continue;
+        posting_t *p = posting_find(keys[i], 1);
+        if (p == NULL) break;
+        if (p->n == p->cap) {
+            uint32_t ncap = p->cap ? p->cap * 2 : 4;
+            uint32_t *ni = realloc(p->ids, sizeof(uint32_t) * ncap);
+            if (ni == NULL) break;
+            p->ids = ni;
+            p->cap = ncap;
+        }
+        p->ids[p->n++] = (uint32_t)id;
+    }
+    if (keys != small) free(keys);
+}
+
+static void index_free(void) {
+    for (size_t i = 0; i < index_cap; ++i) free(index_tab[i].ids);
+    free(index_tab);
+    index_tab = NULL;
+    index_cap = index_used = 0;
+    index_built = 0;
+}
+
+/* Postings of evicted entries are skipped at query time; once the ring
+   has turned over completely the index is rebuilt to drop them. */
+static void index_build(void) {
+    index_free();
+    for (long id = last_id - count + 1; id <= last_id; ++id)
+        index_entry(id, ring[(id - 1) % ring_cap].text);
+    index_built = 1;
+    index_since = 0;
+}
+
+/* ------------------- ring ------------------- */
+
+static void ring_put(char *text, int owned) {
+    hist_slot_t *s = &ring[last_id % ring_cap];
+    if (count == ring_cap && s->owned) free(s->text);
+    s->text = text;
+    s->owned = owned;
+    last_id++;
+    if (count < ring_cap) count++;
+}
+
+long hist_first(void) {
+    return last_id - count + 1;
+}
+
+long hist_last(void) {
+    return last_id;
+}
+
+const char* hist_get(long n) {
+    if (n < 1 || n > last_id || n <= last_id - count) return NULL;
+    return ring[(n - 1) % ring_cap].text;
+}
+
+/* Keep only the newest ring_cap lines when the file has grown past
+   twice that: write them to a temporary file and rename it over. */
+static void history_rotate(const char *path, char **lines, long nlines, long base) {
+    size_t plen = strlen(path);
+    char *tmp = malloc(plen + 5);
+    if (tmp == NULL) return;
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".new", 5);
+    FILE *f = fopen(tmp, "w");
+    if (f != NULL) {
+        fprintf(f, "%s%ld\n", HIST_BASE, base + nlines - ring_cap);
+        for (long i = nlines - ring_cap; i < nlines; ++i) {
+            for (const char *c = lines[i]; *c; ++c) fputc(*c == '\n' ? HIST_NL : *c, f);
+            fputc('\n', f);
+        }
+        if (fclose(f) == 0) rename(tmp, path);
+        else unlink(tmp);
+    }
+    free(tmp);
+}
+
+int hist_open(const char *path) {
+    char buf[4096];
+    if (path == NULL) path = get_var("HISTFILE");
+    if (path == NULL) {
+        const char *home = get_var("HOME");
+        if (home == NULL) return -1;
+        snprintf(buf, sizeof(buf), "%s/.myshell_history", home);
+        path = buf;
+    }
+    const char *size = get_var("HISTSIZE");
+    ring_cap = size && atol(size) > 0 ? atol(size) : HIST_DEFAULT_MAX;
+    ring = calloc((size_t)ring_cap, sizeof(hist_slot_t));
+    if (ring == NULL) return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd >= 0 && fstat(fd, &sb) == 0 && sb.st_size > 0) {
+        map_len = (size_t)sb.st_size;
+        map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            map_len = 0;
+        }
+    }
+    if (fd >= 0) close(fd);
+
+    if (map != NULL) {
+        long nlines = 0, base = 0;
+        char **lines = NULL;
+        long lines_cap = 0;
+        char *p = map, *end = map + map_len;
+        char *nl;
+        size_t blen = strlen(HIST_BASE);
+        if (map_len > blen && memcmp(map, HIST_BASE, blen) == 0 &&
+            (nl = memchr(map, '\n', map_len)) != NULL) {
+            base = strtol(map + blen, NULL, 10);
+            if (base < 0) base = 0;
+            p = nl + 1;
+        }
+        /* a torn final line (no '\n') is ignored */
+        while (p < end && (nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+            *nl = '\0';
+            for (char *c = p; (c = memchr(c, HIST_NL, (size_t)(nl - c))) != NULL; ) *c = '\n';
+            if (nlines == lines_cap) {
+                lines_cap = lines_cap ? lines_cap * 2 : 1024;
+                char **nlp = realloc(lines, sizeof(char*) * (size_t)lines_cap);
+                if (nlp == NULL) break;
+                lines = nlp;
+            }
+            lines[nlines++] = p;
+            p = nl + 1;
+        }
+        /* numbering counts every line in the file, and those rotated out */
+        long skip = nlines > ring_cap ? nlines - ring_cap : 0;
+        last_id = base + skip;
+        for (long i = skip; i < nlines; ++i)
+            ring_put(lines[i], 0);
+        if (nlines > 2 * ring_cap) history_rotate(path, lines, nlines, base);
+        free(lines);
+    }
+
+    hist_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    return hist_fd < 0 ? -1 : 0;
+}
+
+/* O(1): one slot in the ring, one write(2) to the file */
+void hist_add(const char *line) {
+    if (ring == NULL || line == NULL || line[0] == '\0') return;
+    size_t len = strlen(line);
+    char *copy = malloc(len + 2);
+    if (copy == NULL) return;
+
+    if (hist_fd >= 0) {
+        memcpy(copy, line, len);
+        for (char *c = copy; (c = memchr(c, '\n', len - (size_t)(c - copy))) != NULL; ) *c = HIST_NL;
+        copy[len] = '\n';
+        ssize_t w;
+        do {
+            w = write(hist_fd, copy, len + 1);   /* one write: atomic with O_APPEND */
+        } while (w < 0 && errno == EINTR);
+    }
+    memcpy(copy, line, len + 1);
+    ring_put(copy, 1);
+
+    if (index_built) {
+        if (++index_since > ring_cap) index_build();
+        else index_entry(last_id, copy);
+    }
+}
+
+/* Newest entry numbered below `before` that contains needle; 0 if none */
+long hist_search(const char *needle, long before) {
+    if (ring == NULL || needle == NULL) return 0;
+    if (before > last_id + 1 || before <= 0) before = last_id + 1;
+    long first = hist_first();
+    size_t nlen = strlen(needle);
+
+    if (nlen < 3) {
+        for (long id = before - 1; id >= first; --id)
+            if (strstr(hist_get(id), needle) != NULL) return id;
+        return 0;
+    }
+
+    if (!index_built) index_build();
+    posting_t *best = NULL;
+    for (size_t i = 0; i + 2 < nlen; ++i) {
+        posting_t *p = posting_find(trigram(needle + i), 0);
+        if (p == NULL) return 0;
+        if (best == NULL || p->n < best->n) best = p;
+    }
+
+    /* ids are ascending: find the last one below `before`, walk back */
+    size_t lo = 0, hi = best->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((long)best->ids[mid] < before) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0) {
+        long id = best->ids[lo];
+        if (id < first) break;
+        if (strstr(hist_get(id), needle) != NULL) return id;
+    }
+    return 0;
+}
+
+void hist_close(void) {
+    if (ring != NULL) {
+        for (long i = 0; i < ring_cap; ++i)
+            if (ring[i].owned) free(ring[i].text);
+        free(ring);
+        ring = NULL;
+    }
+    index_free();
+    if (map != NULL) munmap(map, map_len);
+    map = NULL;
+    if (hist_fd >= 0) close(hist_fd);
+    hist_fd = -1;
+    count = last_id = 0;
+}
+
+/* history builtin:
+     history          list every entry held, numbered
+     history N        the last N entries
+     history -s TEXT  entries containing TEXT, via the index
+*/
+int history_builtin(char **argv) {
+    long from = hist_first();
+    if (argv[1] != NULL && strcmp(argv[1], "-s") == 0) {
+        if (argv[2] == NULL) {
+            fprintf(stderr, "history: -s: needs a search string\n");
+            return 2;
+        }
+        /* newest first is how the index walks; print oldest first */
+        long cap = 64, n = 0;
+        long *hits = malloc(sizeof(long) * (size_t)cap);
+        for (long id = hist_search(argv[2], 0); hits != NULL && id > 0;
+             id = hist_search(argv[2], id)) {
+            if (n == cap) {
+                cap *= 2;
+                long *nh = realloc(hits, sizeof(long) * (size_t)cap);
+                if (nh == NULL) break;
+                hits = nh;
+            }
+            hits[n++] = id;
+        }
+        while (n-- > 0) printf("%5ld  %s\n", hits[n], hist_get(hits[n]));
+        free(hits);
+        return 0;
+    }
+    if (argv[1] != NULL) {
+        char *end;
+        long n = strtol(argv[1], &end, 10);
+        if (*end != '\0' || n < 0) {
+            fprintf(stderr, "history: %s: numeric argument required\n", argv[1]);
+            return 2;
+        }
+        if (last_id - n + 1 > from) from = last_id - n + 1;
+    }
+    for (long id = from; id <= last_id; ++id)
+        printf("%5ld  %s\n", id, hist_get(id));
+    return 0;
+}
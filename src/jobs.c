@@ -1,96 +1,328 @@
 /* src/jobs.c
- * Job list manager with reaper notifications (defines reap_zombies)
+ * Job table manager with reaper notifications (defines reap_zombies)
+ *
+ * Jobs live in a growable slot table: a job's number is its slot index + 1
+ * and never changes while the job is alive; freed slots are reused lowest
+ * first. Every pid of a pipeline is recorded, and an open-addressing
+ * pid -> slot index makes reaping O(1) per child.
+ *
+ * Children are reaped with wait4, and each job sums the rusage of its
+ * processes so `jobs -l` and `time` can say where CPU and memory went.
  */
 
 #include "shell.h"
 #include <stdio.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <errno.h>
 
-static job_t jobs[MAX_JOBS];
-static int job_count = 0;
+static job_t *jobs = NULL;       /* slot table; jobs[i].id == 0 => free */
+static int job_slots = 0;
+static int job_live = 0;
 
-/* Add a background job (store pid and command string)
-   Returns 1-based job index on success, -1 on failure.
+typedef struct {
+    pid_t pid;                   /* 0 => empty */
+    int slot;
+} pid_entry_t;
+
+static pid_entry_t *pid_index = NULL;
+static size_t pid_cap = 0;       /* power of two */
+static size_t pid_used = 0;
+
+static size_t pid_hash(pid_t pid) {
+    return ((size_t)pid * 2654435761u);
+}
+
+static pid_entry_t* pid_probe(pid_entry_t *tab, size_t cap, pid_t pid) {
+    size_t i = pid_hash(pid) & (cap - 1);
+    while (tab[i].pid != 0 && tab[i].pid != pid)
+        i = (i + 1) & (cap - 1);
+    return &tab[i];
+}
+
+static int pid_index_add(pid_t pid, int slot) {
+    if ((pid_used + 1) * 2 > pid_cap) {
+        size_t ncap = pid_cap ? pid_cap * 2 : 64;
+        pid_entry_t *ntab = calloc(ncap, sizeof(pid_entry_t));
+        if (ntab == NULL) return -1;
+        for (size_t i = 0; i < pid_cap; ++i)
+            if (pid_index[i].pid != 0)
+                *pid_probe(ntab, ncap, pid_index[i].pid) = pid_index[i];
+        free(pid_index);
+        pid_index = ntab;
+        pid_cap = ncap;
+    }
+    pid_entry_t *e = pid_probe(pid_index, pid_cap, pid);
+    if (e->pid == 0) pid_used++;
+    e->pid = pid;
+    e->slot = slot;
+    return 0;
+}
+
+/* Returns the slot owning pid, or -1 */
+static int pid_index_find(pid_t pid) {
+    if (pid_cap == 0) return -1;
+    pid_entry_t *e = pid_probe(pid_index, pid_cap, pid);
+    return e->pid == 0 ? -1 : e->slot;
+}
+
+/* Linear-probing delete with backward shift (no tombstones) */
+static void pid_index_del(pid_t pid) {
+    if (pid_cap == 0) return;
+    pid_entry_t *e = pid_probe(pid_index, pid_cap, pid);
+    if (e->pid == 0) return;
+    e->pid = 0;
+    pid_used--;
+    size_t i = ((size_t)(e - pid_index) + 1) & (pid_cap - 1);
+    while (pid_index[i].pid != 0) {
+        pid_entry_t moved = pid_index[i];
+        pid_index[i].pid = 0;
+        *pid_probe(pid_index, pid_cap, moved.pid) = moved;
+        i = (i + 1) & (pid_cap - 1);
+    }
+}
+
+/* A coprocess' NAME_READ, NAME_WRITE and NAME_PID go with its fds, so a
+   stale `>&$NAME_WRITE` cannot reach whatever reuses the fd number. They
+   are left alone if a newer coprocess of the same NAME has taken them. */
+static void unset_coproc_vars(const job_t *j) {
+    char var[256], num[32];
+    snprintf(var, sizeof(var), "%s_READ", j->coproc);
+    snprintf(num, sizeof(num), "%d", j->fd_read);
+    const char *cur = get_var(var);
+    if (cur == NULL || strcmp(cur, num) != 0) return;
+    unset_var(var);
+    snprintf(var, sizeof(var), "%s_WRITE", j->coproc);
+    unset_var(var);
+    snprintf(var, sizeof(var), "%s_PID", j->coproc);
+    unset_var(var);
+}
+
+static void free_slot(int slot) {
+    job_t *j = &jobs[slot];
+    if (j->coproc != NULL) unset_coproc_vars(j);
+    if (j->fd_read >= 0) close(j->fd_read);
+    if (j->fd_write >= 0) close(j->fd_write);
+    /* reaped pids are zeroed: the kernel may already reuse them elsewhere */
+    for (int k = 0; k < j->npids; ++k)
+        if (j->pids[k] != 0) pid_index_del(j->pids[k]);
+    free(j->pids);
+    free(j->cmd);
+    free(j->coproc);
+    memset(j, 0, sizeof(*j));
+    job_live--;
+}
+
+/* Add a background job made of npids processes (a pipeline's pids in
+   stage order; the last one's status is the job's status).
+   Returns the job number (1-based, stable) on success, -1 on failure.
 */
-int add_job(pid_t pid, const char *cmd) {
-    if (job_count >= MAX_JOBS) {
-        fprintf(stderr, "jobs: job list full, cannot add pid %d\n", (int)pid);
+int add_job(const pid_t *pids, int npids, const char *cmd) {
+    if (pids == NULL || npids <= 0) return -1;
+
+    int slot = -1;
+    for (int i = 0; i < job_slots; ++i) {
+        if (jobs[i].id == 0) { slot = i; break; }
+    }
+    if (slot == -1) {
+        int nslots = job_slots ? job_slots * 2 : 16;
+        job_t *nj = realloc(jobs, sizeof(job_t) * (size_t)nslots);
+        if (nj == NULL) {
+            fprintf(stderr, "jobs: out of memory, cannot add pid %d\n", (int)pids[npids - 1]);
+            return -1;
+        }
+        memset(nj + job_slots, 0, sizeof(job_t) * (size_t)(nslots - job_slots));
+        jobs = nj;
+        slot = job_slots;
+        job_slots = nslots;
+    }
+
+    job_t *j = &jobs[slot];
+    j->pids = malloc(sizeof(pid_t) * (size_t)npids);
+    j->cmd = strdup(cmd ? cmd : "");
+    if (j->pids == NULL || j->cmd == NULL) {
+        free(j->pids);
+        free(j->cmd);
+        memset(j, 0, sizeof(*j));
         return -1;
     }
-    jobs[job_count].pid = pid;
-    strncpy(jobs[job_count].cmd, cmd ? cmd : "", JOB_CMD_LEN - 1);
-    jobs[job_count].cmd[JOB_CMD_LEN - 1] = '\0';
-    job_count++;
-    /* return 1-based job number */
-    return job_count;
+    memcpy(j->pids, pids, sizeof(pid_t) * (size_t)npids);
+    j->npids = npids;
+    j->pid = pids[npids - 1];
+    j->nlive = npids;
+    j->status = 0;
+    j->fd_read = -1;
+    j->fd_write = -1;
+    j->coproc = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &j->start);
+    memset(&j->usage, 0, sizeof(j->usage));
+    j->id = slot + 1;
+    job_live++;
+
+    for (int k = 0; k < npids; ++k) {
+        if (pid_index_add(pids[k], slot) != 0) {
+            fprintf(stderr, "jobs: out of memory indexing pid %d\n", (int)pids[k]);
+        }
+    }
+    return j->id;
 }
 
-/* Remove job by pid (shifts array) */
+/* Make job id coprocess NAME with the shell's ends of its pipes; they
+   are closed, and NAME's variables unset, when the job is removed */
+void job_attach_coproc(int id, const char *name, int fd_read, int fd_write) {
+    if (id < 1 || id > job_slots || jobs[id - 1].id != id) return;
+    jobs[id - 1].fd_read = fd_read;
+    jobs[id - 1].fd_write = fd_write;
+    jobs[id - 1].coproc = strdup(name);
+}
+
+/* The live job numbered id, or NULL. The pointer is only good until the
+   next add_job. */
+const job_t* find_job(int id) {
+    if (id < 1 || id > job_slots || jobs[id - 1].id != id) return NULL;
+    return &jobs[id - 1];
+}
+
+/* Remove the job containing pid */
 void remove_job(pid_t pid) {
-    int found = -1;
-    for (int i = 0; i < job_count; ++i) {
-        if (jobs[i].pid == pid) {
-            found = i;
-            break;
+    int slot = pid_index_find(pid);
+    if (slot != -1) free_slot(slot);
+}
+
+/* Number of background jobs still running */
+int jobs_active(void) {
+    return job_live;
+}
+
+static double tv_seconds(const struct timeval *tv) {
+    return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+/* Accumulate ru into acc: times and counters add up, ru_maxrss (the
+   largest resident set of any one process) takes the maximum */
+void rusage_add(struct rusage *acc, const struct rusage *ru) {
+    timeradd(&acc->ru_utime, &ru->ru_utime, &acc->ru_utime);
+    timeradd(&acc->ru_stime, &ru->ru_stime, &acc->ru_stime);
+    if (ru->ru_maxrss > acc->ru_maxrss) acc->ru_maxrss = ru->ru_maxrss;
+    acc->ru_minflt += ru->ru_minflt;
+    acc->ru_majflt += ru->ru_majflt;
+    acc->ru_nvcsw += ru->ru_nvcsw;
+    acc->ru_nivcsw += ru->ru_nivcsw;
+}
+
+double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_minsec(const char *label, double secs) {
+    int min = (int)(secs / 60);
+    fprintf(stderr, "%s\t%dm%.3fs\n", label, min, secs - 60.0 * min);
+}
+
+/* Report for `time`, on stderr like bash's, plus memory and scheduling */
+void print_time_report(double real, const struct rusage *ru) {
+    fflush(stdout);
+    fprintf(stderr, "\n");
+    print_minsec("real", real);
+    print_minsec("user", tv_seconds(&ru->ru_utime));
+    print_minsec("sys", tv_seconds(&ru->ru_stime));
+    fprintf(stderr, "maxrss\t%ldk\n", ru->ru_maxrss);
+    fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", ru->ru_nvcsw, ru->ru_nivcsw);
+}
+
+/* Print active jobs with their stable job numbers. The long format adds
+   every pid of the pipeline (reaped ones shown as "-"), the wall time so
+   far and the resource usage of the processes already reaped. */
+void print_jobs(int long_format) {
+    for (int i = 0; i < job_slots; ++i) {
+        const job_t *j = &jobs[i];
+        if (j->id == 0) continue;
+        if (!long_format) {
+            printf("[%d] %d %s\n", j->id, (int)j->pid, j->cmd);
+            continue;
+        }
+        printf("[%d]", j->id);
+        for (int k = 0; k < j->npids; ++k) {
+            if (j->pids[k] != 0) printf(" %d", (int)j->pids[k]);
+            else printf(" -");
         }
+        printf(" Running %s\n", j->cmd);
+        printf("    wall %.3fs  user %.3fs  sys %.3fs  maxrss %ldk  ctxsw %ld/%ld  (%d of %d reaped)\n",
+               elapsed_since(&j->start), tv_seconds(&j->usage.ru_utime),
+               tv_seconds(&j->usage.ru_stime), j->usage.ru_maxrss,
+               j->usage.ru_nvcsw, j->usage.ru_nivcsw, j->npids - j->nlive, j->npids);
     }
-    if (found == -1) return;
-    for (int j = found; j < job_count - 1; ++j) jobs[j] = jobs[j + 1];
-    job_count--;
 }
 
-/* Print active jobs with index-based job numbers */
-void print_jobs(void) {
-    for (int i = 0; i < job_count; ++i) {
-        printf("[%d] %d %s\n", i + 1, (int)jobs[i].pid, jobs[i].cmd);
+/* Record that pid exited with wait status `status` and resource usage
+   ru (may be NULL). When that was the
+   job's last live process the job is removed from the table, copied into
+   *finished (the caller then owns finished->cmd) and its id returned.
+   Returns 0 while the job still has live processes, -1 if pid is not a
+   tracked job. */
+int job_note_exit(pid_t pid, int status, const struct rusage *ru, job_t *finished) {
+    int slot = pid_index_find(pid);
+    if (slot == -1) return -1;
+
+    job_t *j = &jobs[slot];
+    pid_index_del(pid);
+    if (ru != NULL) rusage_add(&j->usage, ru);
+    for (int k = 0; k < j->npids; ++k) {
+        if (j->pids[k] != pid) continue;
+        if (k == j->npids - 1) j->status = status;
+        j->pids[k] = 0;
+        break;
     }
+    if (--j->nlive > 0) return 0;
+
+    int id = j->id;
+    *finished = *j;
+    finished->pids = NULL;
+    finished->coproc = NULL;
+    j->cmd = NULL;     /* ownership moves to the caller */
+    free_slot(slot);
+    return id;
+}
+
+/* Print the completion notice for a finished job */
+void print_job_done(const job_t *j) {
+    if (WIFEXITED(j->status)) {
+        printf("\n[%d] Done    %s (exit %d)\n", j->id, j->cmd, WEXITSTATUS(j->status));
+    } else if (WIFSIGNALED(j->status)) {
+        printf("\n[%d] Killed  %s (signal %d)\n", j->id, j->cmd, WTERMSIG(j->status));
+    } else {
+        printf("\n[%d] Finished %s\n", j->id, j->cmd);
+    }
+    fflush(stdout);
 }
 
 /* Reap any finished background children without blocking and notify user.
-   This function name matches what main.c calls: reap_zombies(). */
+   A job is reported once every process of its pipeline has exited. */
 void reap_zombies(void) {
     int status;
     pid_t pid;
+    job_t done;
+    struct rusage ru;
+    int reaped = 0;
+    uint64_t t0 = trace_start();
     /* Loop: multiple children may have terminated */
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        /* find the job entry for this pid so we can show the command when notifying */
-        char saved_cmd[JOB_CMD_LEN] = {0};
-        int found = -1;
-        for (int i = 0; i < job_count; ++i) {
-            if (jobs[i].pid == pid) {
-                strncpy(saved_cmd, jobs[i].cmd, JOB_CMD_LEN - 1);
-                found = i;
-                break;
-            }
-        }
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        reaped++;
+        /* untracked pids are still reaped; live jobs wait for their last pid */
+        if (job_note_exit(pid, status, &ru, &done) <= 0) continue;
 
-        if (found != -1) {
-            int jobnum = found + 1; /* save job number for notification */
-
-            /* Remove the job entry from list */
-            remove_job(pid);
-
-            /* Print a short notification (we call this before printing prompt) */
-            if (WIFEXITED(status)) {
-                int exitcode = WEXITSTATUS(status);
-                printf("\n[%d] Done    %s (exit %d)\n", jobnum, saved_cmd, exitcode);
-            } else if (WIFSIGNALED(status)) {
-                int sig = WTERMSIG(status);
-                printf("\n[%d] Killed  %s (signal %d)\n", jobnum, saved_cmd, sig);
-            } else {
-                printf("\n[%d] Finished %s\n", jobnum, saved_cmd);
-            }
-            fflush(stdout);
-        } else {
-            /* Job not in list, still reaped - ignore or optionally log */
-        }
+        /* Print a short notification (we call this before printing prompt) */
+        print_job_done(&done);
+        free(done.cmd);
     }
     /* if pid == 0 => no child exited; if pid == -1 handle errno */
     if (pid == -1 && errno != ECHILD) {
-        /* Unexpected error from waitpid */
-        perror("waitpid");
+        /* Unexpected error from wait4 */
+        perror("wait4");
     }
+    if (t0 != 0) trace_reap(t0, reaped);
 }
@@ -1,7 +1,11 @@
 /* main.c - Readline-integrated shell main loop
  *
- * Adds background jobs, multi-line if blocks,
- * and Variable Assignment & Expansion (Feature 8).
+ * The thin front end over libmyshell.a: option handling, the interactive
+ * readline loop (history, !n recall, multi-line if/for/while blocks,
+ * job notifications) and nothing else. Parsing, expansion and execution
+ * live in the library. Runs `myshell script` or a non-terminal stdin
+ * through script_run, and `myshell -c string` the same way; readline is
+ * only used (and so only initialized) when the shell is interactive.
  */
 
 #include "shell.h"
@@ -11,60 +15,200 @@
 #include <string.h>
 #include <errno.h>
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+
 /* Readline headers */
 #include <readline/readline.h>
 #include <readline/history.h>
 
-#ifndef HISTORY_SIZE
-#define HISTORY_SIZE 20
-#endif
+/* ---------------- Event-driven line input ----------------
+ * SIGCHLD is blocked and delivered through a signalfd, which is polled
+ * together with stdin while readline runs in callback mode. A background
+ * job that exits while the user is idle is reaped (and reported) right
+ * away, and the prompt with any partially typed text is redrawn.
+ */
+static int sigchld_fd = -1;
+static char *cb_line = NULL;
+static int cb_done = 0;
+
+static void init_child_events(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+        perror("sigprocmask");
+        return;
+    }
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd < 0) {
+        perror("signalfd");
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
+}
+
+static void on_line(char *line) {
+    cb_line = line;
+    cb_done = 1;
+    /* stop readline from printing the prompt again before we return */
+    rl_callback_handler_remove();
+}
+
+static void handle_child_event(void) {
+    struct signalfd_siginfo si;
+    while (read(sigchld_fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+        ;   /* drain: one waitpid loop covers coalesced signals */
 
-/* ---------------- Local history helpers (unchanged) ---------------- */
-static char* history[HISTORY_SIZE] = { NULL };
-static int history_count = 0;
+    /* foreground children were already waited for; only background jobs
+       can produce a notification worth redrawing the prompt for */
+    if (jobs_active() == 0) return;
 
-static void add_history_entry(const char *cmd) {
-    if (cmd == NULL || cmd[0] == '\0') return;
-    if (history_count >= HISTORY_SIZE) {
-        free(history[0]);
-        for (int i = 1; i < HISTORY_SIZE; ++i) history[i - 1] = history[i];
-        history_count = HISTORY_SIZE - 1;
+    rl_clear_visible_line();
+    reap_zombies();
+    rl_on_new_line();
+    rl_redisplay();
+}
+
+/* ---------------- History ----------------
+ * Full history lives in history.c (file-backed ring + trigram index).
+ * readline keeps only the most recent entries for the arrow keys;
+ * Ctrl-R searches everything through the index instead: it takes the
+ * current line as the search text and each further press steps to the
+ * next older match.
+ */
+#define RL_HISTORY_KEEP 1000
+
+static char *search_text = NULL;   /* what Ctrl-R is looking for */
+static long search_hit = 0;        /* entry shown by the last Ctrl-R */
+
+static int indexed_reverse_search(int count, int key) {
+    (void)count;
+    (void)key;
+    const char *shown = search_hit ? hist_get(search_hit) : NULL;
+    if (shown == NULL || strcmp(rl_line_buffer, shown) != 0) {
+        /* the line was edited: start a new search for its text */
+        free(search_text);
+        search_text = strdup(rl_line_buffer);
+        search_hit = 0;
+    }
+    if (search_text == NULL) return 0;
+    long id = hist_search(search_text, search_hit);
+    if (id == 0) {
+        rl_ding();
+        return 0;
     }
-    history[history_count++] = strdup(cmd);
+    search_hit = id;
+    rl_replace_line(hist_get(id), 0);
+    rl_point = rl_end;
+    return 0;
 }
 
-static void print_history(void) {
-    for (int i = 0; i < history_count; ++i)
-        printf("%d %s\n", i + 1, history[i]);
+static void init_history(void) {
+    if (hist_open(NULL) != 0) perror("history");
+    stifle_history(RL_HISTORY_KEEP);
+    long last = hist_last();
+    long from = last - RL_HISTORY_KEEP + 1;
+    if (from < hist_first()) from = hist_first();
+    for (long id = from; id <= last; ++id) add_history(hist_get(id));
+    rl_bind_keyseq("\\C-r", indexed_reverse_search);
 }
 
-static void free_history(void) {
-    for (int i = 0; i < history_count; ++i) {
-        free(history[i]);
-        history[i] = NULL;
+/* Drop-in replacement for readline(prompt) */
+static char* read_line_evented(const char *prompt) {
+    if (sigchld_fd < 0) {
+        reap_zombies();   /* no signalfd: fall back to reaping per prompt */
+        return readline(prompt);
     }
-    history_count = 0;
+
+    cb_line = NULL;
+    cb_done = 0;
+    rl_callback_handler_install(prompt, on_line);
+
+    struct pollfd pfd[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = sigchld_fd,   .events = POLLIN },
+    };
+    while (!cb_done) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (pfd[1].revents & POLLIN) handle_child_event();
+        if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) rl_callback_read_char();
+    }
+    if (!cb_done) rl_callback_handler_remove();
+    return cb_line;
 }
 
-/* Helper: detect a line exactly == fi */
-static int is_fi_line(const char *line) {
-    if (!line) return 0;
-    while (*line == ' ' || *line == '\t') line++;
-    if (strncmp(line, "fi", 2) != 0) return 0;
-    line += 2;
-    while (*line == ' ' || *line == '\t') line++;
-    return *line == '\0';
+/* ---------------- Here-document bodies ---------------- */
+static char* next_prompt_line(void *ctx) {
+    (void)ctx;
+    return read_line_evented("> ");
 }
 
 /* ---------------------- MAIN ---------------------- */
-int main() {
+int main(int argc, char *argv[]) {
     char *cmdline = NULL;
-    char **arglist = NULL;
 
-    while (1) {
-        reap_zombies();  // clean finished background jobs
+    /* The environment becomes the initial set of exported variables */
+    import_environment(environ);
+
+    /* Optional launch backend override, e.g. MYSHELL_SPAWN=fork */
+    const char *backend = getenv("MYSHELL_SPAWN");
+    if (backend && set_spawn_backend(backend) != 0)
+        fprintf(stderr, "MYSHELL_SPAWN: unknown backend '%s'\n", backend);
+
+    /* Pipeline pipe capacity, e.g. MYSHELL_PIPESIZE=max */
+    const char *pipesize = getenv("MYSHELL_PIPESIZE");
+    if (pipesize && set_pipe_size(pipesize) != 0)
+        fprintf(stderr, "MYSHELL_PIPESIZE: invalid size '%s'\n", pipesize);
 
-        cmdline = readline(PROMPT);
+    /* Execution trace: MYSHELL_TRACE_FD=n or a leading --trace-fd=n,
+       e.g. `myshell --trace-fd=3 script 3>trace.jsonl` */
+    const char *trace = getenv("MYSHELL_TRACE_FD");
+    if (argc > 1 && strncmp(argv[1], "--trace-fd=", 11) == 0) {
+        trace = argv[1] + 11;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (trace && trace_open(trace) != 0)
+        fprintf(stderr, "myshell: trace fd '%s' is not open\n", trace);
+
+    /* Command mode: `myshell -c 'cmd; cmd'` runs the string like a script
+       and never touches readline or history. */
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "myshell: -c: option requires an argument\n");
+            return 2;
+        }
+        script_reader_t *r = script_open_string(argv[2]);
+        if (r == NULL) return 1;
+        int status = script_run(r);
+        script_close(r);
+        free_all_variables();
+        return status < 0 ? 1 : status;
+    }
+
+    /* Script mode: `myshell file` or commands piped/redirected on stdin */
+    if (argc > 1 || !isatty(STDIN_FILENO)) {
+        script_reader_t *r = script_open(argc > 1 ? argv[1] : NULL);
+        if (r == NULL) return 127;
+        int status = script_run(r);
+        script_close(r);
+        free_all_variables();
+        return status < 0 ? 1 : status;
+    }
+
+    init_child_events();
+    init_history();
+    builtins_set_interactive();
+
+    while (1) {
+        heredoc_clear();   /* bodies of the previous line */
+        cmdline = read_line_evented(PROMPT);
         if (!cmdline) break;
 
         char *trim = cmdline;
@@ -78,101 +222,92 @@ int main() {
         if (trim[0] == '!') {
             char *endptr;
             long n = strtol(trim + 1, &endptr, 10);
-            if (*endptr != '\0' || n <= 0 || n > history_count) {
+            if (*endptr != '\0' || n <= 0 || hist_get(n) == NULL) {
                 fprintf(stderr, "Invalid history ref: %s\n", trim);
                 free(cmdline);
                 continue;
             }
             free(cmdline);
-            cmdline = strdup(history[n - 1]);
+            cmdline = strdup(hist_get(n));
             trim = cmdline;
         }
 
-        add_history(trim);
-        add_history_entry(cmdline);
+        /* History gets the lines as typed (no here-document bodies),
+           a multi-line block joined into one entry once it closes */
+        char *entry = strdup(trim);
+        search_hit = 0;
 
-        /* Multi-line if-then-else-fi block */
-        if (strncmp(trim, "if", 2) == 0 && (trim[2] == ' ' || trim[2] == '\t' || trim[2] == '\0')) {
+        /* Here-document bodies are read now, at the "> " prompt */
+        char *doc = heredoc_collect(cmdline, next_prompt_line, NULL);
+        if (doc != NULL) {
+            free(cmdline);
+            cmdline = doc;
+            trim = cmdline;
+            while (*trim == ' ' || *trim == '\t') trim++;
+        }
+
+        /* Multi-line compound command: read until every if/for/while closes */
+        int depth = compound_depth(trim);
+        if (depth > 0) {
             size_t len = strlen(trim) + 1;
             char *block = malloc(len);
             strcpy(block, trim);
 
-            while (1) {
-                char *cont = readline("> ");
-                if (!cont) { free(block); break; }
-                if (is_fi_line(cont)) {
-                    size_t newlen = len + strlen("\nfi");
-                    block = realloc(block, newlen);
-                    strcat(block, "\nfi");
+            while (depth > 0) {
+                char *cont = read_line_evented("> ");
+                if (!cont) { free(block); block = NULL; break; }
+                if (entry != NULL) {
+                    size_t elen = strlen(entry);
+                    char *ne = realloc(entry, elen + 1 + strlen(cont) + 1);
+                    if (ne != NULL) {
+                        ne[elen] = '\n';
+                        strcpy(ne + elen + 1, cont);
+                    } else {
+                        free(entry);
+                    }
+                    entry = ne;
+                }
+                char *cont_doc = heredoc_collect(cont, next_prompt_line, NULL);
+                if (cont_doc != NULL) {
                     free(cont);
-                    break;
+                    cont = cont_doc;
                 }
                 size_t newlen = len + strlen("\n") + strlen(cont);
                 block = realloc(block, newlen);
                 strcat(block, "\n");
                 strcat(block, cont);
                 len = newlen;
+                depth += compound_depth(cont);
                 free(cont);
             }
 
             free(cmdline);
+            if (!block) {        /* EOF inside the block */
+                free(entry);
+                break;
+            }
             cmdline = block;
             trim = cmdline;
         }
 
-        /* ---------- Command chaining ---------- */
-        if (strchr(cmdline, ';')) {
-            execute_chained_input(cmdline);
-            free(cmdline);
-            continue;
+        if (entry != NULL) {
+            add_history(entry);
+            hist_add(entry);
+            free(entry);
         }
 
-        /* ---------- Tokenize ---------- */
-        arglist = tokenize(cmdline);
-        if (!arglist) { free(cmdline); continue; }
-
-        /* ---------- FEATURE 8: ASSIGNMENT ---------- */
-        if (arglist[0] && strchr(arglist[0], '=') && arglist[1] == NULL) {
-            char *eq = strchr(arglist[0], '=');
-            if (eq && eq != arglist[0]) {
-                size_t name_len = eq - arglist[0];
-                char name[name_len + 1];
-                strncpy(name, arglist[0], name_len);
-                name[name_len] = '\0';
-                set_var(name, eq + 1);
-            }
-            /* cleanup & skip execution */
-            for (int i = 0; arglist[i]; i++) free(arglist[i]);
-            free(arglist);
+        /* ---------- if / for / while ---------- */
+        if (run_compound(cmdline)) {
             free(cmdline);
             continue;
         }
 
-        /* ---------- FEATURE 8: VARIABLE EXPANSION ---------- */
-        for (int i = 0; arglist[i]; i++) {
-            if (arglist[i][0] == '$' && arglist[i][1] != '\0') {
-                const char *val = get_var(arglist[i] + 1);
-                free(arglist[i]);
-                arglist[i] = strdup(val ? val : "");
-            }
-        }
-
-        /* ---------- Builtins & Execution ---------- */
-        if (strcmp(arglist[0], "history") == 0) {
-            print_history();
-        } else if (strcmp(arglist[0], "jobs") == 0) {
-            print_jobs();
-        } else if (!handle_builtin(arglist)) {
-            if (!handle_if_then_else(cmdline))
-                execute_single(arglist);
-        }
-
-        for (int i = 0; arglist[i]; i++) free(arglist[i]);
-        free(arglist);
+        /* ---------- Chaining, assignment, expansion, builtins, execution ---------- */
+        execute_chained_input(cmdline);
         free(cmdline);
     }
 
-    free_history();
+    hist_close();
     free_all_variables();
     printf("\nShell exited.\n");
     return 0;
@@ -0,0 +1,243 @@
+/* src/pathhash.c
+ * Command -> absolute path cache (the 'hash' builtin).
+ *
+ * execvp walks every $PATH directory on each exec; on slow filesystems
+ * that is many failed execve calls per command. Resolved paths are kept
+ * in an open-addressing table filled on first lookup. The table is
+ * dropped whenever the shell's PATH variable differs from the value it
+ * was built against. A hit is only cached when no relative PATH element
+ * ("", ".", "bin") was searched to reach it, since cd changes what those
+ * name; such commands are looked up again on every call.
+ */
+
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char *name;            /* NULL => empty slot */
+    char *path;
+    unsigned long hits;
+} path_entry_t;
+
+static path_entry_t *table = NULL;
+static size_t table_cap = 0;      /* always a power of two */
+static size_t table_used = 0;
+static char *table_path = NULL;   /* PATH the table was built against */
+static char *uncached = NULL;     /* last relative hit, valid until the next lookup */
+
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+
+/* FNV-1a */
+static size_t hash_str(const char *s) {
+    size_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static path_entry_t* find_slot(path_entry_t *tab, size_t cap, const char *name) {
+    size_t i = hash_str(name) & (cap - 1);
+    while (tab[i].name != NULL && strcmp(tab[i].name, name) != 0)
+        i = (i + 1) & (cap - 1);
+    return &tab[i];
+}
+
+static int grow_table(void) {
+    size_t ncap = table_cap ? table_cap * 2 : 64;
+    path_entry_t *ntab = calloc(ncap, sizeof(path_entry_t));
+    if (ntab == NULL) return -1;
+    for (size_t i = 0; i < table_cap; ++i) {
+        if (table[i].name != NULL)
+            *find_slot(ntab, ncap, table[i].name) = table[i];
+    }
+    free(table);
+    table = ntab;
+    table_cap = ncap;
+    return 0;
+}
+
+void path_cache_clear(void) {
+    for (size_t i = 0; i < table_cap; ++i) {
+        free(table[i].name);
+        free(table[i].path);
+    }
+    free(table);
+    table = NULL;
+    table_cap = 0;
+    table_used = 0;
+    free(table_path);
+    table_path = NULL;
+    free(uncached);
+    uncached = NULL;
+}
+
+/* Drop the table if PATH changed since it was filled */
+static void check_path_env(void) {
+    const char *cur = get_var("PATH");
+    if (cur == NULL) cur = "";
+    if (table_path != NULL && strcmp(table_path, cur) == 0) return;
+    path_cache_clear();
+    table_path = strdup(cur);
+}
+
+/* Walk PATH the way execvp would; returns a malloc'd path or NULL.
+   *relative is set if a relative element was searched on the way. */
+static char* search_path(const char *name, int *relative) {
+    const char *p = get_var("PATH");
+    if (p == NULL) p = "/usr/bin:/bin";
+    size_t nlen = strlen(name);
+    *relative = 0;
+
+    while (1) {
+        const char *colon = strchr(p, ':');
+        size_t dlen = colon ? (size_t)(colon - p) : strlen(p);
+        /* empty element means current directory */
+        const char *dir = dlen ? p : ".";
+        if (!dlen) dlen = 1;
+        if (dir[0] != '/') *relative = 1;
+
+        char *full = malloc(dlen + 1 + nlen + 1);
+        if (full == NULL) return NULL;
+        memcpy(full, dir, dlen);
+        full[dlen] = '/';
+        memcpy(full + dlen + 1, name, nlen + 1);
+
+        struct stat sb;
+        if (stat(full, &sb) == 0 && S_ISREG(sb.st_mode) && access(full, X_OK) == 0)
+            return full;
+        free(full);
+
+        if (colon == NULL) break;
+        p = colon + 1;
+    }
+    return NULL;
+}
+
+static const char* cache_insert(const char *name, char *path) {
+    if ((table_used + 1) * 2 > table_cap && grow_table() != 0) {
+        free(path);
+        return NULL;
+    }
+    path_entry_t *e = find_slot(table, table_cap, name);
+    if (e->name == NULL) {
+        e->name = strdup(name);
+        if (e->name == NULL) {
+            free(path);
+            return NULL;
+        }
+        table_used++;
+    } else {
+        free(e->path);
+    }
+    e->path = path;
+    e->hits = 0;
+    return e->path;
+}
+
+/* Resolve a command name to an absolute path, filling the cache on a miss.
+   Returns NULL for names containing '/', or names not found on PATH
+   (the caller then falls back to execvp for the usual error). A name
+   found via a relative PATH element is returned but not cached. */
+const char* path_cache_lookup(const char *name) {
+    if (name == NULL || name[0] == '\0' || strchr(name, '/') != NULL) return NULL;
+    check_path_env();
+
+    if (table_cap) {
+        path_entry_t *e = find_slot(table, table_cap, name);
+        if (e->name != NULL) {
+            e->hits++;
+            stat_hits++;
+            return e->path;
+        }
+    }
+
+    stat_misses++;
+    int relative;
+    char *path = search_path(name, &relative);
+    if (path == NULL) return NULL;
+    if (relative) {
+        free(uncached);
+        uncached = path;
+        return uncached;
+    }
+    return cache_insert(name, path);
+}
+
+/* Forget one entry (e.g. the binary vanished). Re-inserts the rest of the
+   probe cluster so open addressing stays consistent. */
+void path_cache_forget(const char *name) {
+    if (name == NULL || table_cap == 0) return;
+    path_entry_t *e = find_slot(table, table_cap, name);
+    if (e->name == NULL) return;
+    free(e->name);
+    free(e->path);
+    e->name = NULL;
+    e->path = NULL;
+    table_used--;
+
+    size_t i = ((size_t)(e - table) + 1) & (table_cap - 1);
+    while (table[i].name != NULL) {
+        path_entry_t moved = table[i];
+        table[i].name = NULL;
+        *find_slot(table, table_cap, moved.name) = moved;
+        i = (i + 1) & (table_cap - 1);
+    }
+}
+
+/* hash builtin:
+     hash            list cached commands (hits, command, path)
+     hash -r         clear the cache
+     hash -s         show hit/miss counters
+     hash name...    resolve and cache each name
+*/
+int hash_builtin(char **arglist) {
+    if (arglist[1] == NULL) {
+        check_path_env();
+        if (table_used == 0) {
+            printf("hash: hash table empty\n");
+            return 0;
+        }
+        printf("hits\tcommand\n");
+        for (size_t i = 0; i < table_cap; ++i) {
+            if (table[i].name != NULL)
+                printf("%4lu\t%s\n", table[i].hits, table[i].path);
+        }
+        return 0;
+    }
+
+    if (strcmp(arglist[1], "-r") == 0) {
+        path_cache_clear();
+        return 0;
+    }
+
+    if (strcmp(arglist[1], "-s") == 0) {
+        printf("hits %lu misses %lu entries %zu\n", stat_hits, stat_misses, table_used);
+        return 0;
+    }
+
+    int rc = 0;
+    check_path_env();
+    for (int i = 1; arglist[i] != NULL; ++i) {
+        if (strchr(arglist[i], '/') != NULL) continue;
+        int relative;
+        char *path = search_path(arglist[i], &relative);
+        if (path == NULL) {
+            fprintf(stderr, "hash: %s: not found\n", arglist[i]);
+            rc = 1;
+            continue;
+        }
+        if (relative) {      /* depends on the working directory */
+            free(path);
+            continue;
+        }
+        cache_insert(arglist[i], path);
+    }
+    return rc;
+}
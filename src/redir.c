@@ -0,0 +1,343 @@
+/* src/redir.c
+ * Redirection engine.
+ *
+ * parse_side turns each redirection of a stage ("<", "2>>", "2>&1", "&>",
+ * "3<&-", "<<", "<<<" ...) into fd operations (open, dup2, close, here-
+ * document) kept in source order, so "2>&1 >f" and ">f 2>&1" differ the
+ * way they do in sh. The list is built once per stage and applied once
+ * per process: in a forked child (redir_apply), around an in-process
+ * builtin (redir_apply with saved fds, then redir_restore), or as
+ * posix_spawn file actions (redir_spawn_actions).
+ *
+ * A stage made only of redirections ("< big.log | grep x") copies its
+ * stdin to its stdout with redir_pump, in the kernel where it can.
+ */
+
+#define _GNU_SOURCE  /* pipe2, memfd_create, splice */
+#include "shell.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#define HERE_PIPE_MAX 4096   /* PIPE_BUF: always fits in an empty pipe */
+#define PUMP_CHUNK (1 << 20) /* per splice/sendfile call; a pipe takes what fits */
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Here-document text as a readable O_CLOEXEC fd: small bodies are written
+   into a pipe up front (they fit, so no writer has to stay around),
+   larger ones into an anonymous memfd rewound to offset 0. Nothing is
+   created on the filesystem. Returns -1 on error. */
+static int open_here_fd(const char *text, int add_nl) {
+    size_t len = strlen(text);
+    int fd;
+    if (len + (size_t)add_nl <= HERE_PIPE_MAX) {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            return -1;
+        }
+        if (write_all(p[1], text, len) < 0 || (add_nl && write_all(p[1], "\n", 1) < 0)) {
+            perror("write here-document");
+            close(p[0]);
+            close(p[1]);
+            return -1;
+        }
+        close(p[1]);
+        return p[0];
+    }
+    fd = memfd_create("here-document", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (write_all(fd, text, len) < 0 || (add_nl && write_all(fd, "\n", 1) < 0) ||
+        lseek(fd, 0, SEEK_SET) < 0) {
+        perror("write here-document");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Parse the fd number of a "<&N" / ">&N" target; -1 if word is not one */
+static int parse_fd(const char *word) {
+    if (*word == '\0') return -1;
+    long fd = 0;
+    for (const char *p = word; *p; ++p) {
+        if (*p < '0' || *p > '9') return -1;
+        fd = fd * 10 + (*p - '0');
+        if (fd > REDIR_FD_MAX) return -1;
+    }
+    return (int)fd;
+}
+
+static void set_open(redir_t *r, int fd, const char *path, int oflags) {
+    r->kind = RD_OPEN;
+    r->fd = fd;
+    r->src = -1;
+    r->oflags = oflags;
+    r->text = path;
+    r->add_nl = 0;
+}
+
+/* Translate one operator token and its target word into fd operations
+   appended at out (room for 2). Returns how many were added, or -1 after
+   reporting a bad redirection. */
+int redir_parse(const char *op_tok, const char *target, redir_t *out) {
+    int fd;
+    int op = redir_op(op_tok, &fd);
+    if (op < 0) return -1;
+    if (fd > REDIR_FD_MAX) {
+        fprintf(stderr, "%s: bad file descriptor\n", op_tok);
+        return -1;
+    }
+
+    switch (op) {
+    case REDIR_IN:
+        set_open(out, fd, target, O_RDONLY);
+        return 1;
+    case REDIR_RDWR:
+        set_open(out, fd, target, O_RDWR | O_CREAT);
+        return 1;
+    case REDIR_OUT:
+        set_open(out, fd, target, O_WRONLY | O_CREAT | O_TRUNC);
+        return 1;
+    case REDIR_APPEND:
+        set_open(out, fd, target, O_WRONLY | O_CREAT | O_APPEND);
+        return 1;
+    case REDIR_HEREDOC:
+    case REDIR_HERESTR:
+        out->kind = RD_HERE;
+        out->fd = fd;
+        out->src = -1;
+        out->oflags = 0;
+        out->text = target;
+        out->add_nl = op == REDIR_HERESTR;
+        return 1;
+    case REDIR_DUP_IN:
+    case REDIR_DUP_OUT:
+        if (strcmp(target, "-") == 0) {
+            out->kind = RD_CLOSE;
+            out->fd = fd;
+            out->src = -1;
+            out->text = NULL;
+            return 1;
+        }
+        if (parse_fd(target) >= 0) {
+            out->kind = RD_DUP;
+            out->fd = fd;
+            out->src = parse_fd(target);
+            out->text = NULL;
+            return 1;
+        }
+        if (op == REDIR_DUP_IN || fd != 1 || *target == '\0') {
+            fprintf(stderr, "%s%sambiguous redirect\n", target, *target ? ": " : "");
+            return -1;
+        }
+        /* ">&file" is "&>file" */
+        /* fall through */
+    case REDIR_OUT_ALL:
+    case REDIR_APPEND_ALL:
+        set_open(out, STDOUT_FILENO, target,
+                 O_WRONLY | O_CREAT | (op == REDIR_APPEND_ALL ? O_APPEND : O_TRUNC));
+        out[1].kind = RD_DUP;
+        out[1].fd = STDERR_FILENO;
+        out[1].src = STDOUT_FILENO;
+        out[1].text = NULL;
+        return 2;
+    }
+    return -1;
+}
+
+/* The file or here-document behind r as a new O_CLOEXEC fd >= min_fd;
+   -1 after reporting an error */
+static int open_source(const redir_t *r, int min_fd) {
+    int fd;
+    if (r->kind == RD_HERE) {
+        fd = open_here_fd(r->text, r->add_nl);
+    } else {
+        fd = open(r->text, r->oflags | O_CLOEXEC, 0644);
+        if (fd < 0) perror(r->text);
+    }
+    if (fd >= 0 && fd < min_fd) {
+        int moved = fcntl(fd, F_DUPFD_CLOEXEC, min_fd);
+        close(fd);
+        fd = moved;
+        if (fd < 0) perror("fcntl");
+    }
+    return fd;
+}
+
+/* Remember fd's current state once, before the first operation on it */
+static int save_fd(redir_saved_t *saved, int *nsaved, int fd) {
+    for (int k = 0; k < *nsaved; ++k)
+        if (saved[k].fd == fd) return 0;
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (copy < 0 && errno != EBADF) {
+        perror("fcntl");
+        return -1;
+    }
+    saved[*nsaved].fd = fd;
+    saved[*nsaved].copy = copy;   /* -1: fd was closed */
+    (*nsaved)++;
+    return 0;
+}
+
+/* Apply the n operations in order to the current process. With saved
+   (room for n entries) every fd touched is first copied aside so
+   redir_restore can undo the lot; without it (a child about to exec) the
+   changes are permanent. Returns 0, or -1 after reporting an error
+   (anything already applied stays in saved). */
+int redir_apply(const redir_t *r, int n, redir_saved_t *saved, int *nsaved) {
+    if (nsaved) *nsaved = 0;
+    for (int i = 0; i < n; ++i) {
+        if (saved && save_fd(saved, nsaved, r[i].fd) != 0) return -1;
+        switch (r[i].kind) {
+        case RD_OPEN:
+        case RD_HERE: {
+            int src = open_source(&r[i], 0);
+            if (src < 0) return -1;
+            if (src != r[i].fd) {
+                if (dup2(src, r[i].fd) < 0) {
+                    perror("dup2");
+                    close(src);
+                    return -1;
+                }
+                close(src);
+            } else {
+                fcntl(src, F_SETFD, 0);
+            }
+            break;
+        }
+        case RD_DUP:
+            if (r[i].src != r[i].fd && dup2(r[i].src, r[i].fd) < 0) {
+                fprintf(stderr, "%d: %s\n", r[i].src, strerror(errno));
+                return -1;
+            }
+            break;
+        case RD_CLOSE:
+            close(r[i].fd);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Undo redir_apply, newest first */
+void redir_restore(redir_saved_t *saved, int nsaved) {
+    for (int k = nsaved - 1; k >= 0; --k) {
+        if (saved[k].copy >= 0) {
+            dup2(saved[k].copy, saved[k].fd);
+            close(saved[k].copy);
+        } else {
+            close(saved[k].fd);
+        }
+    }
+}
+
+/* Express the operations as posix_spawn file actions. Files and here-
+   documents are opened here in the parent, so errors name the file, and
+   above every fd the list mentions, so no earlier action clobbers them;
+   their fds go to opened[] (room for n) for the caller to close after
+   the spawn. Returns the number opened, or -1 after reporting an error
+   (with opened[] already closed). */
+int redir_spawn_actions(const redir_t *r, int n, posix_spawn_file_actions_t *fa, int *opened) {
+    int min_fd = 10;
+    for (int i = 0; i < n; ++i) {
+        if (r[i].fd >= min_fd) min_fd = r[i].fd + 1;
+        if (r[i].src >= min_fd) min_fd = r[i].src + 1;
+    }
+
+    int nopened = 0;
+    for (int i = 0; i < n; ++i) {
+        switch (r[i].kind) {
+        case RD_OPEN:
+        case RD_HERE: {
+            int src = open_source(&r[i], min_fd);
+            if (src < 0) goto fail;
+            opened[nopened++] = src;
+            posix_spawn_file_actions_adddup2(fa, src, r[i].fd);
+            break;
+        }
+        case RD_DUP: {
+            /* a source set up by an earlier operation only exists in the child */
+            int earlier = 0;
+            for (int k = 0; k < i; ++k)
+                if (r[k].fd == r[i].src) earlier = 1;
+            if (!earlier && fcntl(r[i].src, F_GETFD) < 0) {
+                fprintf(stderr, "%d: %s\n", r[i].src, strerror(errno));
+                goto fail;
+            }
+            posix_spawn_file_actions_adddup2(fa, r[i].src, r[i].fd);
+            break;
+        }
+        case RD_CLOSE:
+            posix_spawn_file_actions_addclose(fa, r[i].fd);
+            break;
+        }
+    }
+    return nopened;
+
+fail:
+    while (nopened > 0) close(opened[--nopened]);
+    return -1;
+}
+
+/* Copy in_fd to out_fd until EOF. The data stays in the kernel where it
+   can: splice when either side is a pipe, sendfile from a regular file to
+   anything else. Both move the file offset, so when the kernel refuses a
+   pair (EINVAL, e.g. a terminal) a read/write loop carries on from where
+   they stopped. Returns 0, or -1 after reporting an error (a closed
+   reader, EPIPE, is not reported). */
+int redir_pump(int in_fd, int out_fd) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0) {
+        perror("fstat");
+        return -1;
+    }
+    int use_splice = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+    int use_sendfile = !use_splice && S_ISREG(in_st.st_mode);
+
+    while (use_splice || use_sendfile) {
+        ssize_t n = use_splice
+            ? splice(in_fd, NULL, out_fd, NULL, PUMP_CHUNK, SPLICE_F_MOVE)
+            : sendfile(out_fd, in_fd, NULL, PUMP_CHUNK);
+        if (n == 0) return 0;
+        if (n > 0) continue;
+        if (errno == EINTR) continue;
+        if (errno == EPIPE) return -1;   /* the reader is gone: not worth a message */
+        if (errno != EINVAL && errno != ENOSYS) {
+            perror(use_splice ? "splice" : "sendfile");
+            return -1;
+        }
+        break;
+    }
+
+    char buf[65536];
+    for (;;) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            return -1;
+        }
+        if (write_all(out_fd, buf, (size_t)n) < 0) {
+            if (errno != EPIPE) perror("write");
+            return -1;
+        }
+    }
+}
@@ -0,0 +1,222 @@
+/* src/script.c
+ * Line reader for non-interactive (script) mode.
+ *
+ * Regular files are mapped MAP_PRIVATE and split in place: each newline
+ * is overwritten with NUL, so a line costs one memchr and no copy.
+ * Pipes and terminals are read in 64 KiB blocks into a growable buffer
+ * and split the same way. `-c` strings are split in place too.
+ * Lines stay valid until the next call. script_run executes a whole
+ * script (script files, piped stdin and `-c` all go through it).
+ */
+
+#include "shell.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SCRIPT_BLOCK (64 * 1024)
+
+script_reader_t* script_open(const char *path) {
+    script_reader_t *r = calloc(1, sizeof(script_reader_t));
+    if (r == NULL) return NULL;
+
+    if (path == NULL) {
+        r->fd = STDIN_FILENO;
+    } else {
+        r->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (r->fd < 0) {
+            perror(path);
+            free(r);
+            return NULL;
+        }
+        r->owns_fd = 1;
+    }
+
+    struct stat sb;
+    if (fstat(r->fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+        lseek(r->fd, 0, SEEK_CUR) == 0) {
+        void *p = mmap(NULL, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, r->fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)sb.st_size, MADV_SEQUENTIAL);
+            r->buf = p;
+            r->len = (size_t)sb.st_size;
+            r->mapped = 1;
+            r->eof = 1;
+            /* a script reading its own stdin must not see the mapped bytes again */
+            if (path == NULL) lseek(r->fd, sb.st_size, SEEK_SET);
+        }
+    }
+    return r;
+}
+
+/* Read lines straight out of a caller-owned, NUL-terminated string
+   (used by `myshell -c`). The string is split in place. */
+script_reader_t* script_open_string(char *text) {
+    script_reader_t *r = calloc(1, sizeof(script_reader_t));
+    if (r == NULL) return NULL;
+    r->fd = -1;
+    r->buf = text;
+    r->len = strlen(text);
+    r->borrowed = 1;
+    r->eof = 1;
+    return r;
+}
+
+/* Block-read more input behind the unread tail (buffered mode only) */
+static int script_fill(script_reader_t *r) {
+    if (r->pos > 0) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    if (r->cap - r->len < SCRIPT_BLOCK + 1) {
+        size_t ncap = r->cap ? r->cap * 2 : 2 * SCRIPT_BLOCK;
+        while (ncap - r->len < SCRIPT_BLOCK + 1) ncap *= 2;
+        char *nb = realloc(r->buf, ncap);
+        if (nb == NULL) return -1;
+        r->buf = nb;
+        r->cap = ncap;
+    }
+    ssize_t n;
+    do {
+        n = read(r->fd, r->buf + r->len, SCRIPT_BLOCK);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        r->eof = 1;
+        return n < 0 ? -1 : 0;
+    }
+    r->len += (size_t)n;
+    return 1;
+}
+
+char* script_next_line(script_reader_t *r) {
+    char *nl;
+    while (1) {
+        nl = r->pos < r->len ? memchr(r->buf + r->pos, '\n', r->len - r->pos) : NULL;
+        if (nl != NULL || r->eof) break;
+        if (script_fill(r) < 0) {
+            perror("read");
+            break;
+        }
+    }
+
+    if (r->pos >= r->len) return NULL;
+
+    char *line = r->buf + r->pos;
+    size_t n;
+    if (nl != NULL) {
+        n = (size_t)(nl - line);
+        r->pos += n + 1;
+    } else {
+        /* last line without a newline: the mapping has no spare byte */
+        n = r->len - r->pos;
+        r->pos = r->len;
+        if (r->mapped) {
+            free(r->tail);
+            r->tail = malloc(n + 1);
+            if (r->tail == NULL) return NULL;
+            memcpy(r->tail, line, n);
+            line = r->tail;
+        }
+    }
+    if (n > 0 && line[n - 1] == '\r') n--;
+    line[n] = '\0';
+    r->lineno++;
+    return line;
+}
+
+void script_close(script_reader_t *r) {
+    if (r == NULL) return;
+    if (r->mapped)
+        munmap(r->buf, r->len);
+    else if (!r->borrowed)
+        free(r->buf);
+    free(r->tail);
+    if (r->owns_fd) close(r->fd);
+    free(r);
+}
+
+/* ---------------- Script mode ---------------- */
+
+static char* next_script_line(void *ctx) {
+    char *line = script_next_line(ctx);
+    return line ? strdup(line) : NULL;
+}
+
+/* heredoc_collect for a script line. The line is copied first, since
+   reading the body may refill (and move) the reader's buffer. Returns a
+   malloc'd replacement line, or NULL if the line has no here-document. */
+static char* script_heredocs(script_reader_t *r, const char *line) {
+    if (strstr(line, "<<") == NULL) return NULL;
+    char *copy = strdup(line);
+    if (copy == NULL) return NULL;
+    char *out = heredoc_collect(copy, next_script_line, r);
+    free(copy);
+    return out;
+}
+
+/* Run every command of a script. No readline, prompt or history: '#'
+   comments and blank lines are skipped, here-document bodies are read
+   from the script itself, and compound commands (if/for/while) are
+   gathered into one reusable buffer. Returns the status of the last
+   command. */
+int script_run(script_reader_t *r) {
+    char *block = NULL;
+    size_t block_cap = 0;
+    int status = 0;
+    char *line;
+
+    while ((line = script_next_line(r)) != NULL) {
+        while (*line == ' ' || *line == '\t') line++;
+        if (*line == '\0' || *line == '#') continue;
+
+        char *doc_line = script_heredocs(r, line);
+        if (doc_line != NULL) line = doc_line;
+
+        if (compound_depth(line) > 0) {
+            size_t len = 0;
+            int depth = 0;
+            int closed = 0;
+            for (char *part = line; part != NULL; part = script_next_line(r)) {
+                char *doc_part = part != line ? script_heredocs(r, part) : NULL;
+                if (doc_part != NULL) part = doc_part;
+                size_t n = strlen(part);
+                if (len + n + 2 > block_cap) {
+                    size_t ncap = block_cap ? block_cap * 2 : 1024;
+                    while (ncap < len + n + 2) ncap *= 2;
+                    char *nb = realloc(block, ncap);
+                    if (nb == NULL) { perror("realloc"); break; }
+                    block = nb;
+                    block_cap = ncap;
+                }
+                if (len) block[len++] = '\n';
+                memcpy(block + len, part, n + 1);
+                len += n;
+                free(doc_part);
+                depth += compound_depth(block + len - n);
+                if (depth <= 0) { closed = 1; break; }
+            }
+            if (!closed) {
+                fprintf(stderr, "line %ld: syntax error: missing 'fi' or 'done'\n", r->lineno);
+                status = 2;
+                free(doc_line);
+                break;
+            }
+            line = block;
+        }
+
+        if (run_compound(line))
+            status = get_last_status();
+        else
+            status = execute_chained_input(line);
+        free(doc_line);
+        heredoc_clear();
+
+        /* no prompt to hang notifications on: reap between lines, and
+           only when background jobs exist */
+        if (jobs_active()) reap_zombies();
+    }
+
+    free(block);
+    return status;
+}
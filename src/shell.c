@@ -1,255 +1,526 @@
 #include "shell.h"
 
 #include <stddef.h>
-#include <strings.h> /* for bzero */
+#include <ctype.h>
+
+/* ------------------- Token arena ------------------- */
+
+#define ARENA_INLINE_ARGS 16
+
+/* A fresh line costs one malloc: the tokens_t header, an inline argv of
+   ARENA_INLINE_ARGS slots and a first chunk big enough for every token of
+   the line. Only lines with more tokens, or expansions that add text,
+   allocate again. */
+arena_chunk_t* arena_new_chunk(size_t cap) {
+    arena_chunk_t *c = malloc(sizeof(arena_chunk_t) + cap);
+    if (c == NULL) return NULL;
+    c->next = NULL;
+    c->used = 0;
+    c->cap = cap;
+    return c;
+}
+
+char* tokens_alloc(tokens_t *t, size_t n) {
+    arena_chunk_t *c = t->chunk;
+    if (c->cap - c->used < n) {
+        /* geometric, but an adopted output chunk must not set the pace */
+        size_t cap = c->cap < 32768 ? c->cap * 2 : 65536;
+        if (cap < n) cap = n;
+        arena_chunk_t *nc = arena_new_chunk(cap);
+        if (nc == NULL) return NULL;
+        nc->next = c;
+        t->chunk = nc;
+        c = nc;
+    }
+    char *p = c->data + c->used;
+    c->used += n;
+    return p;
+}
+
+char* tokens_strdup(tokens_t *t, const char *s) {
+    size_t n = strlen(s) + 1;
+    char *p = tokens_alloc(t, n);
+    if (p != NULL) memcpy(p, s, n);
+    return p;
+}
 
-/* ------------------- existing functions (unchanged except minor edits) ------------------ */
+/* Hand a separately built chunk (e.g. captured command output) to the
+   arena so free_tokens releases it. It is marked full, so later
+   allocations start a fresh chunk instead of carving from it. */
+void tokens_adopt_chunk(tokens_t *t, arena_chunk_t *c) {
+    c->used = c->cap;
+    c->next = t->chunk;
+    t->chunk = c;
+}
+
+/* Append a token (already arena- or statically-owned) with its TOK_*
+   quoting flags, keeping argv NULL-terminated */
+int tokens_push(tokens_t *t, char *tok, int flags) {
+    if (t->argc + 1 >= t->argv_cap) {
+        int ncap = t->argv_cap * 2;
+        char **nargv;
+        unsigned char *nflags;
+        if (t->argv == t->inline_argv) {
+            nargv = malloc(sizeof(char*) * (size_t)ncap);
+            nflags = malloc((size_t)ncap);
+            if (nargv == NULL || nflags == NULL) {
+                free(nargv);
+                free(nflags);
+                return -1;
+            }
+            memcpy(nargv, t->argv, sizeof(char*) * (size_t)t->argc);
+            memcpy(nflags, t->flags, (size_t)t->argc);
+        } else {
+            nargv = realloc(t->argv, sizeof(char*) * (size_t)ncap);
+            if (nargv == NULL) return -1;
+            t->argv = nargv;
+            nflags = realloc(t->flags, (size_t)ncap);
+            if (nflags == NULL) return -1;
+        }
+        t->argv = nargv;
+        t->flags = nflags;
+        t->argv_cap = ncap;
+    }
+    t->flags[t->argc] = (unsigned char)flags;
+    t->argv[t->argc++] = tok;
+    t->argv[t->argc] = NULL;
+    return 0;
+}
 
-char* read_cmd(char* prompt, FILE* fp) {
-    printf("%s", prompt);
-    char* cmdline = (char*) malloc(sizeof(char) * MAX_LEN);
-    int c, pos = 0;
+size_t redir_span(const char *p) {
+    const char *q = p;
+    while (*q >= '0' && *q <= '9') q++;
+    if (q > p && *q != '<' && *q != '>') return 0;   /* digits are a word */
+    if (q[0] == '<') {
+        if (q[1] == '<') return (size_t)(q - p) + (q[2] == '<' ? 3 : 2);
+        return (size_t)(q - p) + (q[1] == '&' || q[1] == '>' ? 2 : 1);
+    }
+    if (q[0] == '>')
+        return (size_t)(q - p) + (q[1] == '>' || q[1] == '&' || q[1] == '|' ? 2 : 1);
+    if (q[0] == '&' && q[1] == '>') return q[2] == '>' ? 3 : 2;
+    return 0;
+}
 
-    while ((c = getc(fp)) != EOF) {
-        if (c == '\n') break;
-        cmdline[pos++] = c;
+int redir_op(const char *tok, int *fd) {
+    size_t n = redir_span(tok);
+    if (n == 0 || tok[n] != '\0') return -1;
+
+    const char *q = tok;
+    long num = -1;
+    if (*q >= '0' && *q <= '9') {
+        num = 0;
+        while (*q >= '0' && *q <= '9') {
+            if (num < 100000) num = num * 10 + (*q - '0');
+            q++;
+        }
     }
+    int op;
+    if (q[0] == '&') op = q[2] == '>' ? REDIR_APPEND_ALL : REDIR_OUT_ALL;
+    else if (strcmp(q, "<<<") == 0) op = REDIR_HERESTR;
+    else if (strcmp(q, "<<") == 0) op = REDIR_HEREDOC;
+    else if (strcmp(q, "<&") == 0) op = REDIR_DUP_IN;
+    else if (strcmp(q, "<>") == 0) op = REDIR_RDWR;
+    else if (q[0] == '<') op = REDIR_IN;
+    else if (strcmp(q, ">>") == 0) op = REDIR_APPEND;
+    else if (strcmp(q, ">&") == 0) op = REDIR_DUP_OUT;
+    else op = REDIR_OUT;
+
+    if (num < 0) num = q[0] == '<' ? 0 : 1;
+    *fd = (int)num;
+    return op;
+}
 
-    if (c == EOF && pos == 0) {
-        free(cmdline);
-        return NULL; // Handle Ctrl+D
+/* Length of the command substitution starting at p: "$(...)" with
+   nested parentheses and quotes, or "`...`". 0 if p does not start one
+   or it is unterminated (the text is then taken literally). */
+size_t subst_span(const char *p) {
+    if (p[0] == '`') {
+        const char *e = strchr(p + 1, '`');
+        return e ? (size_t)(e - p) + 1 : 0;
     }
-    
-    cmdline[pos] = '\0';
-    return cmdline;
+    if (p[0] != '$' || p[1] != '(') return 0;
+    int depth = 0;
+    char quote = 0;
+    for (const char *q = p + 1; *q; ++q) {
+        if (quote) {
+            if (*q == quote) quote = 0;
+        } else if (*q == '"' || *q == '\'') {
+            quote = *q;
+        } else if (*q == '(') {
+            depth++;
+        } else if (*q == ')' && --depth == 0) {
+            return (size_t)(q - p) + 1;
+        }
+    }
+    return 0;
 }
 
-char** tokenize(char* cmdline) {
+void free_tokens(tokens_t *t) {
+    if (t == NULL) return;
+    if (t->argv != t->inline_argv) {
+        free(t->argv);
+        free(t->flags);
+    }
+    /* the last chunk in the list is the one embedded in the header block */
+    arena_chunk_t *c = t->chunk;
+    while (c != NULL && c->next != NULL) {
+        arena_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(t);
+}
+
+/* Header, inline argv/flags and a first chunk of `bytes`, in one malloc */
+static tokens_t* tokens_new(size_t bytes) {
+    size_t head = sizeof(tokens_t) + sizeof(char*) * ARENA_INLINE_ARGS + ARENA_INLINE_ARGS;
+    head = (head + _Alignof(arena_chunk_t) - 1) & ~(_Alignof(arena_chunk_t) - 1);
+
+    tokens_t *t = malloc(head + sizeof(arena_chunk_t) + bytes);
+    if (t == NULL) return NULL;
+    t->inline_argv = (char**)(t + 1);
+    t->argv = t->inline_argv;
+    t->flags = (unsigned char*)(t->inline_argv + ARENA_INLINE_ARGS);
+    t->argc = 0;
+    t->argv_cap = ARENA_INLINE_ARGS;
+    t->argv[0] = NULL;
+    t->chunk = (arena_chunk_t*)((char*)t + head);
+    t->chunk->next = NULL;
+    t->chunk->used = 0;
+    t->chunk->cap = bytes;
+    return t;
+}
+
+/* A fresh header whose argv/flags copy src's, pointing at src's strings
+   (which must outlive it) with an empty chunk for whatever expansion adds.
+   Lets a pre-parsed command be expanded and run repeatedly without
+   re-tokenizing; expansion never writes to the shared strings. */
+tokens_t* tokens_share(const tokens_t *src) {
+    tokens_t *t = tokens_new(256);
+    if (t == NULL) return NULL;
+
+    for (int i = 0; i < src->argc; ++i) {
+        if (tokens_push(t, src->argv[i], src->flags[i]) != 0) {
+            free_tokens(t);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+static tokens_t* tokenize_line(char* cmdline) {
     if (cmdline == NULL || cmdline[0] == '\0' || cmdline[0] == '\n') {
         return NULL;
     }
 
-    char** arglist = (char**)malloc(sizeof(char*) * (MAXARGS + 1));
-    for (int i = 0; i < MAXARGS + 1; i++) {
-        arglist[i] = (char*)malloc(sizeof(char) * ARGLEN);
-        bzero(arglist[i], ARGLEN);
-    }
+    /* Every token is a run of input bytes plus a NUL, and each token
+       consumes at least one input byte, so 2*len+1 always suffices. */
+    size_t len = strlen(cmdline);
+    tokens_t *t = tokens_new(2 * len + 1);
+    if (t == NULL) return NULL;
 
     char *cp = cmdline;
-    int argnum = 0;
 
-    while (*cp != '\0' && argnum < MAXARGS) {
+    while (*cp != '\0') {
         while (*cp == ' ' || *cp == '\t') cp++;
         if (*cp == '\0' || *cp == '\n') break;
 
-        if (*cp == '<' || *cp == '>' || *cp == '|') {
-            arglist[argnum][0] = *cp;
-            arglist[argnum][1] = '\0';
-            argnum++;
-            cp++;
-            continue;
-        }
-
-        if (*cp == '"' || *cp == '\'') {
+        char *tok = t->chunk->data + t->chunk->used;
+        size_t i = 0;
+        int flags = 0;
+
+        size_t rlen = redir_span(cp);
+        if (rlen > 0) {
+            /* redirection operator, e.g. "<", "2>>", "2>&", "&>", "<<<" */
+            memcpy(tok, cp, rlen);
+            i = rlen;
+            cp += rlen;
+        } else if (*cp == '|') {
+            tok[i++] = *cp++;
+        } else if (*cp == '"' || *cp == '\'') {
             char quote = *cp;
+            flags = quote == '"' ? TOK_QUOTED : TOK_QUOTED | TOK_LITERAL;
             cp++;
-            int i = 0;
-            while (*cp != '\0' && *cp != quote && i < ARGLEN - 1) {
-                arglist[argnum][i++] = *cp;
-                cp++;
+            while (*cp != '\0' && *cp != quote) {
+                size_t span = quote == '"' ? subst_span(cp) : 0;
+                if (span) {
+                    memcpy(tok + i, cp, span);
+                    i += span;
+                    cp += span;
+                } else {
+                    tok[i++] = *cp++;
+                }
             }
-            arglist[argnum][i] = '\0';
             if (*cp == quote) cp++;
-            argnum++;
-            continue;
+        } else {
+            /* a $(...) or `...` is part of the word, spaces and all */
+            while (*cp != '\0' && *cp != ' ' && *cp != '\t' &&
+                   *cp != '<' && *cp != '>' && *cp != '|' && *cp != '\n' &&
+                   !(cp[0] == '&' && cp[1] == '>')) {
+                size_t span = subst_span(cp);
+                if (span) {
+                    memcpy(tok + i, cp, span);
+                    i += span;
+                    cp += span;
+                } else {
+                    tok[i++] = *cp++;
+                }
+            }
         }
+        tok[i] = '\0';
+        t->chunk->used += i + 1;
 
-        int i = 0;
-        while (*cp != '\0' && *cp != ' ' && *cp != '\t' &&
-               *cp != '<' && *cp != '>' && *cp != '|' && *cp != '\n' &&
-               i < ARGLEN - 1) {
-            arglist[argnum][i++] = *cp;
-            cp++;
+        if (tokens_push(t, tok, flags) != 0) {
+            free_tokens(t);
+            return NULL;
         }
-        arglist[argnum][i] = '\0';
-        argnum++;
     }
 
-    if (argnum == 0) {
-        for (int i = 0; i < MAXARGS + 1; i++) free(arglist[i]);
-        free(arglist);
+    if (t->argc == 0) {
+        free_tokens(t);
         return NULL;
     }
+    return t;
+}
 
-    arglist[argnum] = NULL;
-    return arglist;
+tokens_t* tokenize(char* cmdline) {
+    uint64_t t0 = trace_start();
+    tokens_t *t = tokenize_line(cmdline);
+    trace_stop(TR_TOKENIZE, t0);
+    return t;
 }
 
-/* ------------------- Variable store implementation (linked list) ------------------- */
+/* ------------------- Variable store implementation (hash table) ------------------- */
+
+/* Variables live in a dense, insertion-ordered array; an open-addressing
+   index of int slots maps name hashes to positions in it. A name is
+   interned once when its variable is created (with its hash cached), so
+   probes compare hashes first and value updates never touch the name.
+   Exported variables are also kept as a ready-made envp array that is
+   rebuilt lazily, only after an exported value or export flag changed. */
 
-typedef struct varnode {
-    char *name;
+typedef struct {
+    char *name;          /* interned, owned by the entry */
+    size_t hash;
     char *value;
-    struct varnode *next;
-} varnode_t;
+    int exported;
+} var_t;
+
+static var_t *vars = NULL;       /* dense, insertion order */
+static size_t var_count = 0;
+static size_t var_cap = 0;
+
+static int *var_index = NULL;    /* -1 => empty, else position in vars[] */
+static size_t index_cap = 0;     /* power of two */
+
+static char **env_snapshot = NULL;
+static int env_dirty = 1;
+
+static size_t var_hash(const char *s) {
+    size_t h = 1469598103934665603ULL;   /* FNV-1a */
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Returns the index slot for name: either holding it or the empty slot
+   where it would go. */
+static int* var_probe(const char *name, size_t h) {
+    size_t i = h & (index_cap - 1);
+    while (var_index[i] != -1) {
+        var_t *v = &vars[var_index[i]];
+        if (v->hash == h && strcmp(v->name, name) == 0) break;
+        i = (i + 1) & (index_cap - 1);
+    }
+    return &var_index[i];
+}
+
+static int var_reindex(size_t ncap) {
+    int *nidx = malloc(sizeof(int) * ncap);
+    if (nidx == NULL) return -1;
+    for (size_t i = 0; i < ncap; ++i) nidx[i] = -1;
+    free(var_index);
+    var_index = nidx;
+    index_cap = ncap;
+    for (size_t k = 0; k < var_count; ++k)
+        *var_probe(vars[k].name, vars[k].hash) = (int)k;
+    return 0;
+}
+
+static var_t* find_var(const char *name) {
+    if (index_cap == 0) return NULL;
+    int *slot = var_probe(name, var_hash(name));
+    return *slot == -1 ? NULL : &vars[*slot];
+}
 
-static varnode_t *var_head = NULL;
+/* Find or create the variable; NULL on allocation failure */
+static var_t* intern_var(const char *name) {
+    if (index_cap == 0 && var_reindex(64) != 0) return NULL;
+    size_t h = var_hash(name);
+    int *slot = var_probe(name, h);
+    if (*slot != -1) return &vars[*slot];
+
+    /* keep the index at most half full */
+    if ((var_count + 1) * 2 > index_cap) {
+        if (var_reindex(index_cap * 2) != 0) return NULL;
+        slot = var_probe(name, h);
+    }
+    if (var_count == var_cap) {
+        size_t ncap = var_cap ? var_cap * 2 : 32;
+        var_t *nv = realloc(vars, sizeof(var_t) * ncap);
+        if (nv == NULL) return NULL;
+        vars = nv;
+        var_cap = ncap;
+    }
+    var_t *v = &vars[var_count];
+    v->name = strdup(name);
+    v->value = strdup("");
+    if (v->name == NULL || v->value == NULL) {
+        free(v->name);
+        free(v->value);
+        return NULL;
+    }
+    v->hash = h;
+    v->exported = 0;
+    *slot = (int)var_count++;
+    return v;
+}
 
 /* set_var: add or update a variable */
 int set_var(const char *name, const char *value) {
     if (name == NULL) return -1;
     if (name[0] == '\0') return -1;
-    /* find existing */
-    varnode_t *cur = var_head;
-    while (cur != NULL) {
-        if (strcmp(cur->name, name) == 0) {
-            /* update */
-            free(cur->value);
-            cur->value = strdup(value ? value : "");
-            if (cur->value == NULL) return -1;
-            return 0;
-        }
-        cur = cur->next;
-    }
-    /* not found: create new node */
-    varnode_t *node = (varnode_t*)malloc(sizeof(varnode_t));
-    if (!node) return -1;
-    node->name = strdup(name);
-    node->value = strdup(value ? value : "");
-    if (!node->name || !node->value) {
-        free(node->name);
-        free(node->value);
-        free(node);
-        return -1;
-    }
-    node->next = var_head;
-    var_head = node;
+    var_t *v = intern_var(name);
+    if (v == NULL) return -1;
+    char *nv = strdup(value ? value : "");
+    if (nv == NULL) return -1;
+    free(v->value);
+    v->value = nv;
+    if (v->exported) env_dirty = 1;
     return 0;
 }
 
 /* get_var: return internal pointer to value or NULL */
 const char* get_var(const char *name) {
     if (name == NULL) return NULL;
-    varnode_t *cur = var_head;
-    while (cur != NULL) {
-        if (strcmp(cur->name, name) == 0) {
-            return cur->value;
-        }
-        cur = cur->next;
-    }
-    return NULL;
+    var_t *v = find_var(name);
+    return v ? v->value : NULL;
 }
 
-/* print_all_variables: implement 'set' builtin behaviour (prints name=value) */
-void print_all_variables(void) {
-    varnode_t *cur = var_head;
-    while (cur != NULL) {
-        printf("%s=%s\n", cur->name, cur->value);
-        cur = cur->next;
-    }
+/* unset_var: remove a variable; 0 if it existed, -1 if not. The dense
+   array is closed up, keeping insertion order, and re-indexed in place. */
+int unset_var(const char *name) {
+    if (name == NULL || index_cap == 0) return -1;
+    int *slot = var_probe(name, var_hash(name));
+    if (*slot == -1) return -1;
+    size_t k = (size_t)*slot;
+    if (vars[k].exported) env_dirty = 1;
+    free(vars[k].name);
+    free(vars[k].value);
+    memmove(&vars[k], &vars[k + 1], sizeof(var_t) * (var_count - k - 1));
+    var_count--;
+    for (size_t i = 0; i < index_cap; ++i) var_index[i] = -1;
+    for (size_t i = 0; i < var_count; ++i)
+        *var_probe(vars[i].name, vars[i].hash) = (int)i;
+    return 0;
 }
 
-/* free_all_variables: cleanup on shell exit */
-void free_all_variables(void) {
-    varnode_t *cur = var_head;
-    while (cur != NULL) {
-        varnode_t *next = cur->next;
-        free(cur->name);
-        free(cur->value);
-        free(cur);
-        cur = next;
-    }
-    var_head = NULL;
+/* is_valid_name: [A-Za-z_][A-Za-z0-9_]* */
+int is_valid_name(const char *name) {
+    if (name == NULL || !(isalpha((unsigned char)*name) || *name == '_')) return 0;
+    for (++name; *name; ++name)
+        if (!(isalnum((unsigned char)*name) || *name == '_')) return 0;
+    return 1;
 }
 
-/* ------------------- builtins & if-then-else (slightly modified) ------------------- */
-
-int handle_builtin(char** arglist) {
-    if (arglist[0] == NULL) {
-        return 1;
-    }
-
-    if (strcmp(arglist[0], "exit") == 0) {
-        /* cleanup variables before exit */
-        free_all_variables();
-        printf("Exiting shell...\n");
-        exit(0);
+/* export_var: mark a variable exported, creating it (empty) if needed.
+   A non-NULL value is assigned first. */
+int export_var(const char *name, const char *value) {
+    if (name == NULL || name[0] == '\0') return -1;
+    var_t *v = intern_var(name);
+    if (v == NULL) return -1;
+    if (value != NULL && set_var(name, value) != 0) return -1;
+    if (!v->exported) {
+        v->exported = 1;
+        env_dirty = 1;
     }
+    return 0;
+}
 
-    if (strcmp(arglist[0], "cd") == 0) {
-        char *targetDir = arglist[1];
-        if (targetDir == NULL) {
-            targetDir = getenv("HOME");
-            if (targetDir == NULL) {
-                fprintf(stderr, "cd: HOME not set\n");
-                return 1;
-            }
-        }
-        if (chdir(targetDir) != 0) { 
-            perror("cd");
-        }
-        return 1;
+/* Import the process environment as exported variables (shell startup) */
+void import_environment(char **envp) {
+    for (int i = 0; envp && envp[i]; ++i) {
+        char *eq = strchr(envp[i], '=');
+        if (eq == NULL || eq == envp[i]) continue;
+        size_t n = (size_t)(eq - envp[i]);
+        char name[n + 1];
+        memcpy(name, envp[i], n);
+        name[n] = '\0';
+        export_var(name, eq + 1);
     }
+}
 
-    if (strcmp(arglist[0], "help") == 0) {
-        printf("Built-in commands:\n");
-        printf("  cd <dir>    - change directory\n"); 
-        printf("  exit        - exit the shell\n");
-        printf("  help        - show this message\n");
-        printf("  jobs        - job control not implemented yet\n");
-        printf("  if ... then ... else ... fi - simple conditional\n");
-        printf("  set         - print defined shell variables (name=value)\n");
-        return 1;
-    }
+/* get_exported_env: NULL-terminated "NAME=value" array for exec.
+   Rebuilt only when the exported set changed since the last call. */
+char** get_exported_env(void) {
+    if (!env_dirty && env_snapshot != NULL) return env_snapshot;
 
-    if (strcmp(arglist[0], "jobs") == 0) {
-        printf("Job control not yet implemented.\n");
-        return 1;
+    if (env_snapshot != NULL) {
+        for (int i = 0; env_snapshot[i]; ++i) free(env_snapshot[i]);
+        free(env_snapshot);
     }
-
-    /* NEW: set builtin (print variables) */
-    if (strcmp(arglist[0], "set") == 0) {
-        print_all_variables();   // prints name=value
-        return 1;
+    size_t n = 0;
+    for (size_t k = 0; k < var_count; ++k) n += vars[k].exported;
+    env_snapshot = malloc(sizeof(char*) * (n + 1));
+    if (env_snapshot == NULL) return NULL;
+
+    size_t e = 0;
+    for (size_t k = 0; k < var_count; ++k) {
+        if (!vars[k].exported) continue;
+        size_t nl = strlen(vars[k].name), vl = strlen(vars[k].value);
+        char *str = malloc(nl + 1 + vl + 1);
+        if (str == NULL) continue;
+        memcpy(str, vars[k].name, nl);
+        str[nl] = '=';
+        memcpy(str + nl + 1, vars[k].value, vl + 1);
+        env_snapshot[e++] = str;
     }
-
-    return 0;
+    env_snapshot[e] = NULL;
+    env_dirty = 0;
+    return env_snapshot;
 }
 
-// NEW: Handle if-then-else logic
-int handle_if_then_else(char* cmdline) {
-    if (strncmp(cmdline, "if ", 3) != 0) return 0; // Not an if command
-
-    char *then_part = strstr(cmdline, "then");
-    char *else_part = strstr(cmdline, "else");
-    char *fi_part   = strstr(cmdline, "fi");
+/* print_all_variables: implement 'set' builtin behaviour (prints name=value) */
+void print_all_variables(void) {
+    for (size_t k = 0; k < var_count; ++k)
+        printf("%s=%s\n", vars[k].name, vars[k].value);
+}
 
-    if (!then_part || !fi_part) {
-        fprintf(stderr, "Syntax error: missing 'then' or 'fi'\n");
-        return 1;
-    }
+/* print_exported_variables: 'export' with no arguments */
+void print_exported_variables(void) {
+    for (size_t k = 0; k < var_count; ++k)
+        if (vars[k].exported)
+            printf("export %s=%s\n", vars[k].name, vars[k].value);
+}
 
-    // Split parts safely
-    *then_part = '\0';
-    then_part += 4; // skip 'then'
-    if (else_part) {
-        *else_part = '\0';
-        else_part += 4; // skip 'else'
+/* free_all_variables: cleanup on shell exit */
+void free_all_variables(void) {
+    for (size_t k = 0; k < var_count; ++k) {
+        free(vars[k].name);
+        free(vars[k].value);
     }
-    *fi_part = '\0';
-
-    char *if_cmd = cmdline + 3;
-    while (*if_cmd == ' ') if_cmd++;
-
-    // Execute IF command
-    int ret = system(if_cmd);
-
-    if (ret == 0) {
-        system(then_part);
-    } else if (else_part) {
-        system(else_part);
+    free(vars);
+    free(var_index);
+    vars = NULL;
+    var_index = NULL;
+    var_count = var_cap = index_cap = 0;
+
+    if (env_snapshot != NULL) {
+        for (int i = 0; env_snapshot[i]; ++i) free(env_snapshot[i]);
+        free(env_snapshot);
+        env_snapshot = NULL;
     }
-
-    return 1; // handled
+    env_dirty = 1;
 }
-
@@ -0,0 +1,168 @@
+/* src/trace.c
+ * Opt-in execution trace (MYSHELL_TRACE_FD=n or --trace-fd=n).
+ *
+ * Each traced phase (tokenize, expansion, PATH lookup, spawn, redirection
+ * setup, in-process builtin, wait) appends a {phase, start, duration}
+ * event to the current command's record; execute_tokens flushes the
+ * record as one JSON line when the command finishes, and reap_zombies
+ * writes a line of its own. Timestamps are CLOCK_MONOTONIC nanoseconds.
+ * Work done ahead of a command (an if/loop body is tokenized once, up
+ * front) is charged to the next line written.
+ *
+ * Off, every probe is an inline test of trace_fd (see shell.h); no clock
+ * is read and nothing here runs.
+ */
+
+#include "shell.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#define TRACE_MAX_EVENTS 64
+#define TRACE_LINE_MAX 8192
+
+int trace_fd = -1;
+
+static const char *const phase_names[TR_NPHASES] = {
+    "tokenize", "expand", "path", "spawn", "redirect", "builtin", "wait"
+};
+
+typedef struct {
+    int phase;
+    uint64_t start;
+    uint64_t ns;
+} trace_event_t;
+
+static trace_event_t events[TRACE_MAX_EVENTS];
+static int nevents = 0;
+static int dropped = 0;
+static pid_t record_pid = 0;   /* a forked subshell starts its own record */
+
+/* Enable tracing to fd, e.g. "3" from MYSHELL_TRACE_FD. The fd is kept
+   out of exec'd commands. Returns 0, or -1 if spec is not an open fd. */
+int trace_open(const char *spec) {
+    char *end;
+    long fd = strtol(spec, &end, 10);
+    if (end == spec || *end != '\0' || fd < 0 || fd > 1023 || fcntl((int)fd, F_GETFD) < 0)
+        return -1;
+    if ((int)fd > STDERR_FILENO) fcntl((int)fd, F_SETFD, FD_CLOEXEC);
+    trace_fd = (int)fd;
+    return 0;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void trace_phase(int phase, uint64_t t0) {
+    uint64_t t1 = trace_now();
+    pid_t self = getpid();
+    if (self != record_pid) {
+        record_pid = self;
+        nevents = 0;
+        dropped = 0;
+    }
+    if (nevents == TRACE_MAX_EVENTS) {
+        dropped++;
+        return;
+    }
+    events[nevents].phase = phase;
+    events[nevents].start = t0;
+    events[nevents].ns = t1 - t0;
+    nevents++;
+}
+
+/* Append printf-style text to buf, never past TRACE_LINE_MAX - 2 (room
+   is kept for the closing "}\n") */
+static size_t put(char *buf, size_t len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static size_t put(char *buf, size_t len, const char *fmt, ...) {
+    if (len >= TRACE_LINE_MAX - 2) return len;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + len, TRACE_LINE_MAX - 2 - len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return len;
+    len += (size_t)n;
+    return len < TRACE_LINE_MAX - 2 ? len : TRACE_LINE_MAX - 3;
+}
+
+/* Append the words of argv as one JSON string (at most ~256 bytes) */
+static size_t put_cmd(char *buf, size_t len, char **argv) {
+    size_t budget = 256;
+    buf[len++] = '"';
+    for (int i = 0; argv != NULL && argv[i] != NULL && budget > 0; ++i) {
+        if (i > 0) {
+            buf[len++] = ' ';
+            budget--;
+        }
+        for (const unsigned char *s = (const unsigned char*)argv[i]; *s && budget > 0; ++s, --budget) {
+            if (*s == '"' || *s == '\\') {
+                buf[len++] = '\\';
+                buf[len++] = (char)*s;
+            } else if (*s < 0x20) {
+                len += (size_t)snprintf(buf + len, 7, "\\u%04x", *s);
+            } else {
+                buf[len++] = (char)*s;
+            }
+        }
+    }
+    buf[len++] = '"';
+    return len;
+}
+
+static void emit(char *buf, size_t len) {
+    buf[len++] = '}';
+    buf[len++] = '\n';
+    ssize_t n;
+    do {
+        n = write(trace_fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+}
+
+/* Write the current record as one line and start a new one:
+   {"pid":..,"t0":..,"ns":..,"status":..,"cmd":"..","phases":[{"phase":..,"at":..,"ns":..},..]}
+   "t0" is the earliest event's start, "at" is relative to it. */
+void trace_command(char **argv, int status) {
+    if (getpid() != record_pid) {
+        record_pid = getpid();
+        nevents = 0;
+        dropped = 0;
+    }
+    uint64_t end = trace_now();
+    uint64_t t0 = end;
+    for (int i = 0; i < nevents; ++i)      /* events are logged as they end */
+        if (events[i].start < t0) t0 = events[i].start;
+
+    char buf[TRACE_LINE_MAX];
+    size_t len = put(buf, 0, "{\"pid\":%d,\"t0\":%llu,\"ns\":%llu,\"status\":%d,\"cmd\":",
+                     (int)record_pid, (unsigned long long)t0,
+                     (unsigned long long)(end - t0), status);
+    len = put_cmd(buf, len, argv);
+    len = put(buf, len, ",\"phases\":[");
+    for (int i = 0; i < nevents; ++i) {
+        len = put(buf, len, "%s{\"phase\":\"%s\",\"at\":%llu,\"ns\":%llu}", i ? "," : "",
+                  phase_names[events[i].phase],
+                  (unsigned long long)(events[i].start - t0),
+                  (unsigned long long)events[i].ns);
+    }
+    len = put(buf, len, "]");
+    if (dropped) len = put(buf, len, ",\"dropped\":%d", dropped);
+    emit(buf, len);
+
+    nevents = 0;
+    dropped = 0;
+}
+
+/* reap_zombies is timed on its own line: {"pid":..,"t0":..,"ns":..,"reap":n} */
+void trace_reap(uint64_t t0, int reaped) {
+    uint64_t end = trace_now();
+    char buf[TRACE_LINE_MAX];
+    size_t len = put(buf, 0, "{\"pid\":%d,\"t0\":%llu,\"ns\":%llu,\"reap\":%d",
+                     (int)getpid(), (unsigned long long)t0,
+                     (unsigned long long)(end - t0), reaped);
+    emit(buf, len);
+}